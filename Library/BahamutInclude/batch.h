@@ -0,0 +1,588 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                        batch.h                                  //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2018 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "defines.h"
+#include "shader.h"
+#include "texture.h"
+
+#if defined(BMT_USE_NAMESPACE) 
+namespace bmt {
+#endif
+
+#ifndef BATCH_MAX_SPRITES
+#define BATCH_MAX_SPRITES	    20000
+#endif
+
+#define BATCH_MAX_TEXTURES		16
+#define BATCH_MAX_ATTRIBS		16
+
+//frames of vertices a streaming vertex buffer holds. Flushes append to the ring, which is
+//fenced once per frame and grows when it can not hold this many frames, so writing only
+//waits on the GPU when the GPU falls more than this many frames behind.
+#ifndef BATCH_RING_FRAMES
+#define BATCH_RING_FRAMES	    3
+#endif
+
+//sampler uniforms of the texture slots, a vertex with texture slot n samples tex<n>
+INTERNAL const GLchar* BATCH_TEXTURE_UNIFORMS[BATCH_MAX_TEXTURES] = {
+	"tex1", "tex2", "tex3", "tex4", "tex5", "tex6", "tex7", "tex8",
+	"tex9", "tex10", "tex11", "tex12", "tex13", "tex14", "tex15", "tex16"
+};
+
+//One input of a vertex format: the shader attribute it feeds and where it sits in the vertex
+struct VertexAttrib {
+	const GLchar* name;
+	GLint size;				//components (1 to 4)
+	GLenum type;			//GL_FLOAT, GL_UNSIGNED_BYTE, ...
+	GLboolean normalized;	//integers arrive in the shader as 0 to 1 floats
+	u32 offset;
+};
+
+#define VERTEX_ATTRIB(vertex, member, name, size, type, normalized) \
+	{ name, size, type, normalized, (u32)offsetof(vertex, member) }
+
+//================================================
+//Description: The compile-time description of a 
+//	vertex format, specialized for every vertex
+//	type with BATCH_VERTEX_LAYOUT.
+//================================================
+template<typename VertexT>
+struct VertexLayout;
+
+//==========================================================================================
+//Description: Describes the attributes of a vertex type so Batch<VertexT> can feed it to 
+//	shaders, for example:
+//
+//		struct DissolveVertex { vec2 pos; vec2 uv; f32 texid; f32 dissolve; };
+//		BATCH_VERTEX_LAYOUT(DissolveVertex,
+//			VERTEX_ATTRIB(DissolveVertex, pos, "position", 2, GL_FLOAT, GL_FALSE),
+//			VERTEX_ATTRIB(DissolveVertex, uv, "uv", 2, GL_FLOAT, GL_FALSE),
+//			VERTEX_ATTRIB(DissolveVertex, texid, "texid", 1, GL_FLOAT, GL_FALSE),
+//			VERTEX_ATTRIB(DissolveVertex, dissolve, "dissolve", 1, GL_FLOAT, GL_FALSE)
+//		);
+//
+//Comments: Has to be used at namespace scope, inside namespace bmt when BMT_USE_NAMESPACE 
+//		is defined.
+//==========================================================================================
+#define BATCH_VERTEX_LAYOUT(vertex, ...) \
+	template<> \
+	struct VertexLayout<vertex> { \
+		static const VertexAttrib* attribs(u32* count) { \
+			static const VertexAttrib list[] = { __VA_ARGS__ }; \
+			static_assert(sizeof(list) / sizeof(list[0]) <= BATCH_MAX_ATTRIBS, "too many vertex attributes"); \
+			*count = sizeof(list) / sizeof(list[0]); \
+			return list; \
+		} \
+	}
+
+//==========================================================================================
+//Description: Points the enabled attribute arrays at a vertex buffer laid out as described
+//
+//Parameters: 
+//		-The attributes, their count and the size of a vertex
+//		-The offset of the first vertex in the bound GL_ARRAY_BUFFER
+//		-The attribute location of every attribute, or NULL to use their index
+//==========================================================================================
+INTERNAL inline
+void set_layout_attribs(const VertexAttrib* attribs, u32 count, GLsizei stride, GLintptr base, const GLint* locations) {
+	for (u32 i = 0; i < count; ++i) {
+		GLint location = (locations != NULL) ? locations[i] : (GLint)i;
+		if (location < 0)
+			continue;
+		const VertexAttrib& attrib = attribs[i];
+		glVertexAttribPointer(location, attrib.size, attrib.type, attrib.normalized, stride, (const GLvoid*)(base + attrib.offset));
+	}
+}
+
+//==========================================================================================
+//Description: Fills an element buffer with two triangles per sprite.
+//==========================================================================================
+template <class T>
+INTERNAL
+void fill_quad_indices(T* indices, u32 spritecount) {
+	u32 offset = 0;
+	for (u32 i = 0; i < spritecount * 6; i += 6) {
+		indices[i] = offset + 0;
+		indices[i + 1] = offset + 1;
+		indices[i + 2] = offset + 2;
+		indices[i + 3] = offset + 2;
+		indices[i + 4] = offset + 3;
+		indices[i + 5] = offset + 0;
+
+		offset += 4;
+	}
+}
+
+//==========================================================================================
+//Description: Creates the element buffer drawing capacity quads (four vertices each) and 
+//	binds it to GL_ELEMENT_ARRAY_BUFFER
+//
+//Comments: Stores the index type in type. 16 bit indices are used when they can address 
+//		every vertex (up to 16384 quads).
+//==========================================================================================
+INTERNAL inline
+GLuint create_quad_index_buffer(u32 capacity, GLenum* type) {
+	*type = (capacity * 4 - 1 > 0xFFFF) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+	u32 indexsize = (*type == GL_UNSIGNED_INT) ? sizeof(GLuint) : sizeof(GLushort);
+	void* indices = malloc(capacity * 6 * indexsize);
+	if (*type == GL_UNSIGNED_INT)
+		fill_quad_indices((GLuint*)indices, capacity);
+	else
+		fill_quad_indices((GLushort*)indices, capacity);
+
+	GLuint ebo;
+	glGenBuffers(1, &ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, capacity * 6 * indexsize, indices, GL_STATIC_DRAW);
+	free(indices);
+	return ebo;
+}
+
+//==========================================================================================
+//Description: Returns the slot (1 based) a texture already has in a batch, or 0
+//==========================================================================================
+INTERNAL inline
+u16 find_texture_slot(const GLuint* textures, u16 texcount, GLuint ID) {
+	for (u16 i = 0; i < texcount; ++i) {
+		if (textures[i] == ID)
+			return i + 1;
+	}
+	return 0;
+}
+
+//==========================================================================================
+//Description: Binds the textures of a batch to their units and points the shader's 
+//	samplers at them
+//==========================================================================================
+INTERNAL inline
+void bind_batch_textures(Shader shader, const GLuint* textures, u16 texcount) {
+	for (u16 i = 0; i < texcount; ++i) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		upload_int(shader, BATCH_TEXTURE_UNIFORMS[i], i);
+	}
+}
+
+//================================================
+//Description: A vertex buffer that batches are
+//	appended to, fenced once per frame. The
+//	buffer is mapped persistently where buffer 
+//	storage is supported, otherwise every batch 
+//	maps its range unsynchronized. Positions are
+//	counted in bytes since the ring was created,
+//	so they only ever grow.
+//================================================
+struct RingFrame {
+	GLsync fence;
+	u64 end;	//position the frame's writes ended at
+	u64 frame;
+};
+
+struct StreamRing {
+	GLuint vbo;
+	GLsizeiptr section_bytes;	//the most one batch writes
+	GLsizeiptr size;
+	u8* base;		//the persistent mapping, NULL without one
+	GLintptr head;	//offset of the batch being written
+	u64 written;	//position of the next batch
+	u64 retired;	//everything before it was read by the GPU
+	u64 fenced;		//end of the last fenced frame
+	u64 frame;
+	RingFrame frames[BATCH_RING_FRAMES];	//unretired frames, oldest first
+	u32 framecount;
+	bool persistent;
+	bool synced;
+};
+
+//==========================================================================================
+//Description: Allocates the ring's buffer and leaves it bound to GL_ARRAY_BUFFER
+//==========================================================================================
+INTERNAL inline
+void allocate_stream_ring(StreamRing& ring, GLsizeiptr size) {
+	ring.size = size;
+	ring.head = 0;
+	ring.written = ring.retired = ring.fenced = 0;
+	ring.base = NULL;
+
+	glGenBuffers(1, &ring.vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, ring.vbo);
+	if (ring.persistent) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+		ring.base = (u8*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+	}
+	else {
+		glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+	}
+}
+
+INTERNAL inline
+void release_stream_ring(StreamRing& ring) {
+	for (u32 i = 0; i < ring.framecount; ++i)
+		glDeleteSync(ring.frames[i].fence);
+	ring.framecount = 0;
+	if (ring.persistent) {
+		glBindBuffer(GL_ARRAY_BUFFER, ring.vbo);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		ring.base = NULL;
+	}
+	glDeleteBuffers(1, &ring.vbo);
+	ring.vbo = 0;
+}
+
+//==========================================================================================
+//Description: Creates the ring's vertex buffer and leaves it bound to GL_ARRAY_BUFFER
+//
+//Parameters: 
+//		-The ring to create
+//		-The size in bytes of one batch
+//
+//Comments: The ring starts with room for a full batch every frame it holds, and doubles 
+//		whenever frames turn out larger.
+//==========================================================================================
+INTERNAL inline
+void create_stream_ring(StreamRing& ring, GLsizeiptr section_bytes) {
+	ring.section_bytes = section_bytes;
+	ring.persistent = (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) != 0;
+	ring.synced = (GLEW_VERSION_3_2 || GLEW_ARB_sync) != 0;
+	ring.persistent = ring.persistent && ring.synced;
+	ring.frame = 0;
+	ring.framecount = 0;
+	allocate_stream_ring(ring, section_bytes * (BATCH_RING_FRAMES + 1));
+}
+
+//==========================================================================================
+//Description: Marks the end of a frame. Its writes are retired together once the GPU 
+//	has passed the fence.
+//==========================================================================================
+INTERNAL inline
+void fence_stream_ring(StreamRing& ring) {
+	ring.frame++;
+	if (!ring.synced || ring.vbo == 0 || ring.written == ring.fenced)
+		return;
+
+	//GPU commands complete in order, so the newer fence also covers the oldest frame
+	if (ring.framecount == BATCH_RING_FRAMES) {
+		glDeleteSync(ring.frames[0].fence);
+		ring.frames[0] = ring.frames[1];
+		for (u32 i = 1; i + 1 < BATCH_RING_FRAMES; ++i)
+			ring.frames[i] = ring.frames[i + 1];
+		ring.framecount--;
+	}
+	RingFrame& frame = ring.frames[ring.framecount++];
+	frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame.end = ring.written;
+	frame.frame = ring.frame;
+	ring.fenced = ring.written;
+}
+
+//==========================================================================================
+//Description: Starts over in a buffer twice the size. The old buffer is deleted, which 
+//	GL defers until the draws reading it are done.
+//==========================================================================================
+INTERNAL inline
+void grow_stream_ring(StreamRing& ring) {
+	GLsizeiptr grown = ring.size * 2;
+	release_stream_ring(ring);
+	allocate_stream_ring(ring, grown);
+	BMT_LOG(INFO, "Streaming vertex buffer grown to %d KB", (i32)(grown / 1024));
+}
+
+//==========================================================================================
+//Description: Makes room for size bytes at ring.written by retiring the oldest frames.
+//	A frame from the last BATCH_RING_FRAMES the GPU has not finished yet means the ring
+//	is too small, so it grows rather than wait.
+//==========================================================================================
+INTERNAL inline
+void reserve_stream_ring(StreamRing& ring, GLsizeiptr size) {
+	while (ring.written + size - ring.retired > (u64)ring.size) {
+		if (ring.framecount == 0) {
+			//this frame alone fills the ring
+			grow_stream_ring(ring);
+			return;
+		}
+
+		RingFrame& oldest = ring.frames[0];
+		GLenum result = glClientWaitSync(oldest.fence, 0, 0);
+		if (result == GL_TIMEOUT_EXPIRED && oldest.frame + BATCH_RING_FRAMES > ring.frame) {
+			grow_stream_ring(ring);
+			return;
+		}
+		//the GPU is more than BATCH_RING_FRAMES behind, waiting on it keeps it from falling further
+		while (result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+
+		glDeleteSync(oldest.fence);
+		ring.retired = oldest.end;
+		for (u32 i = 0; i + 1 < ring.framecount; ++i)
+			ring.frames[i] = ring.frames[i + 1];
+		ring.framecount--;
+	}
+}
+
+//==========================================================================================
+//Description: Returns the next free batch-sized range of the ring to write into
+//==========================================================================================
+INTERNAL inline
+void* map_stream_ring(StreamRing& ring) {
+	//a batch never straddles the end of the buffer, the rest of the lap is skipped
+	u64 offset = ring.written % ring.size;
+	if (offset + ring.section_bytes > (u64)ring.size) {
+		ring.written += ring.size - offset;
+		//without fences the only safe way to reuse the start of the ring is to orphan it
+		if (!ring.synced) {
+			glBindBuffer(GL_ARRAY_BUFFER, ring.vbo);
+			glBufferData(GL_ARRAY_BUFFER, ring.size, NULL, GL_STREAM_DRAW);
+			ring.retired = ring.written;
+		}
+	}
+	if (ring.synced)
+		reserve_stream_ring(ring, ring.section_bytes);
+	ring.head = ring.written % ring.size;
+
+	if (ring.persistent)
+		return ring.base + ring.head;
+
+	glBindBuffer(GL_ARRAY_BUFFER, ring.vbo);
+	return glMapBufferRange(GL_ARRAY_BUFFER, ring.head, ring.section_bytes,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+	);
+}
+
+//==========================================================================================
+//Description: Ends writing to the range from map_stream_ring() and leaves the ring's 
+//	buffer bound to GL_ARRAY_BUFFER for drawing from it
+//==========================================================================================
+INTERNAL inline
+void unmap_stream_ring(StreamRing& ring) {
+	glBindBuffer(GL_ARRAY_BUFFER, ring.vbo);
+	if (!ring.persistent)
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+}
+
+//==========================================================================================
+//Description: Moves past the bytes drawn from the current range
+//==========================================================================================
+INTERNAL inline
+void advance_stream_ring(StreamRing& ring, GLsizeiptr used) {
+	ring.written += used;
+}
+
+INTERNAL inline
+void dispose_stream_ring(StreamRing& ring) {
+	release_stream_ring(ring);
+}
+
+//================================================
+//Description: A quad batcher for any vertex 
+//	format described with BATCH_VERTEX_LAYOUT. 
+//	Vertices are written straight into a 
+//	StreamRing and drawn with as few draw calls as
+//	the texture slots allow, like the default 2D
+//	renderer.
+//================================================
+template<typename VertexT>
+struct Batch {
+	GLuint vao;
+	StreamRing ring;
+	GLuint ebo;
+	GLenum index_type;
+	u32 capacity;	//quads per draw call
+	VertexT* start;
+	VertexT* buffer;
+	VertexT* end;
+	GLuint textures[BATCH_MAX_TEXTURES];
+	u16 texcount;
+	Shader shader;
+	GLint locations[BATCH_MAX_ATTRIBS];
+	u32 attribcount;
+	u32 drawcalls;	//since create_batch
+};
+
+//==========================================================================================
+//Description: Creates a batch for VertexT
+//
+//Parameters: 
+//		-(OPTIONAL) The number of quads drawn per draw call (default = BATCH_MAX_SPRITES)
+//==========================================================================================
+template<typename VertexT>
+Batch<VertexT> create_batch(u32 capacity = BATCH_MAX_SPRITES) {
+	Batch<VertexT> batch = {};
+	batch.capacity = (capacity == 0) ? BATCH_MAX_SPRITES : capacity;
+
+	glGenVertexArrays(1, &batch.vao);
+	glBindVertexArray(batch.vao);
+	create_stream_ring(batch.ring, (GLsizeiptr)batch.capacity * 4 * sizeof(VertexT));
+	batch.ebo = create_quad_index_buffer(batch.capacity, &batch.index_type);
+
+	//the vao must be unbound before the buffers
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	return batch;
+}
+
+//==========================================================================================
+//Description: Points the batch at the next free range of its ring
+//==========================================================================================
+template<typename VertexT>
+INTERNAL
+void map_batch(Batch<VertexT>& batch) {
+	batch.start = (VertexT*)map_stream_ring(batch.ring);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	batch.buffer = batch.start;
+	batch.end = batch.start + batch.capacity * 4;
+	batch.texcount = 0;
+}
+
+//==========================================================================================
+//Description: Draws what was written into the ring since map_batch() and moves past it
+//==========================================================================================
+template<typename VertexT>
+INTERNAL
+void draw_batch(Batch<VertexT>& batch) {
+	u32 quads = (u32)(batch.buffer - batch.start) / 4;
+	unmap_stream_ring(batch.ring);
+	batch.start = batch.buffer = batch.end = NULL;
+	if (quads > 0) {
+		u32 count;
+		const VertexAttrib* attribs = VertexLayout<VertexT>::attribs(&count);
+		bind_batch_textures(batch.shader, batch.textures, batch.texcount);
+		glBindVertexArray(batch.vao);
+		set_layout_attribs(attribs, count, sizeof(VertexT), batch.ring.head, batch.locations);
+		glDrawElements(GL_TRIANGLES, quads * 6, batch.index_type, 0);
+		glBindVertexArray(0);
+		batch.drawcalls++;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	advance_stream_ring(batch.ring, (GLsizeiptr)quads * 4 * sizeof(VertexT));
+}
+
+//==========================================================================================
+//Description: Starts the shader and maps the batch. The attributes of VertexT are looked
+//	up in the shader by name, so the shader does not have to bind them to locations.
+//==========================================================================================
+template<typename VertexT>
+void begin_batch(Batch<VertexT>& batch, Shader shader) {
+	batch.shader = shader;
+	start_shader(shader);
+
+	u32 count;
+	const VertexAttrib* attribs = VertexLayout<VertexT>::attribs(&count);
+	glBindVertexArray(batch.vao);
+	for (u32 i = 0; i < batch.attribcount; ++i) {
+		if (batch.locations[i] >= 0)
+			glDisableVertexAttribArray(batch.locations[i]);
+	}
+	batch.attribcount = count;
+	for (u32 i = 0; i < count; ++i) {
+		batch.locations[i] = glGetAttribLocation(shader.ID, attribs[i].name);
+		if (batch.locations[i] >= 0)
+			glEnableVertexAttribArray(batch.locations[i]);
+	}
+	glBindVertexArray(0);
+
+	map_batch(batch);
+}
+
+//==========================================================================================
+//Description: Draws everything written so far and starts over with an empty batch
+//==========================================================================================
+template<typename VertexT>
+void flush_batch(Batch<VertexT>& batch) {
+	draw_batch(batch);
+	map_batch(batch);
+}
+
+//==========================================================================================
+//Description: Reserves a quad in the batch and returns its four vertices to write, in the 
+//	order top left, bottom left, bottom right, top right
+//
+//Parameters: 
+//		-A batch between begin_batch() and end_batch()
+//		-(OPTIONAL) A texture the quad samples (default = NULL)
+//		-(OPTIONAL) Where to store the texture slot to write into the vertices, 0 without a
+//			texture (default = NULL)
+//
+//Comments: Flushes first if the batch is full or out of texture slots. The vertices point
+//		into mapped GL memory, write them but never read them back.
+//==========================================================================================
+template<typename VertexT>
+VertexT* push_quad(Batch<VertexT>& batch, const Texture* tex = NULL, f32* texslot = NULL) {
+	if (batch.buffer + 4 > batch.end)
+		flush_batch(batch);
+
+	u16 slot = 0;
+	if (tex != NULL) {
+		slot = find_texture_slot(batch.textures, batch.texcount, tex->ID);
+		if (slot == 0) {
+			if (batch.texcount >= BATCH_MAX_TEXTURES)
+				flush_batch(batch);
+			batch.textures[batch.texcount++] = tex->ID;
+			slot = batch.texcount;
+		}
+	}
+	if (texslot != NULL)
+		*texslot = slot;
+
+	VertexT* quad = batch.buffer;
+	batch.buffer += 4;
+	return quad;
+}
+
+//==========================================================================================
+//Description: Draws what is left in the batch and stops the shader. Each begin/end pair
+//	counts as a frame of the batch's StreamRing.
+//==========================================================================================
+template<typename VertexT>
+void end_batch(Batch<VertexT>& batch) {
+	u16 boundcount = batch.texcount;
+	draw_batch(batch);
+	fence_stream_ring(batch.ring);
+	for (u16 i = 0; i < boundcount; ++i)
+		unbind_texture(i);
+	stop_shader();
+}
+
+template<typename VertexT>
+void dispose_batch(Batch<VertexT>& batch) {
+	dispose_stream_ring(batch.ring);
+	glDeleteBuffers(1, &batch.ebo);
+	glDeleteVertexArrays(1, &batch.vao);
+	batch = {};
+}
+
+#if defined(BMT_USE_NAMESPACE) 
+}
+#endif
+
+#endif
@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                     postprocess.h                               //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2018 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef POSTPROCESS_H
+#define POSTPROCESS_H
+
+#include "defines.h"
+#include "shader.h"
+#include "texture.h"
+
+#if defined(BMT_USE_NAMESPACE) 
+namespace bmt {
+#endif
+
+#ifndef POST_MAX_PASSES
+#define POST_MAX_PASSES		16
+#endif
+
+//output scales of a pass, the pipeline keeps two targets for each one it uses
+#define POST_SCALE_FULL		1
+#define POST_SCALE_HALF		2
+#define POST_SCALE_QUARTER	4
+#define POST_SCALE_LEVELS	3
+
+//================================================
+//Description: One fullscreen pass. It reads the
+//	output of the previous pass (the scene for 
+//	the first pass) and renders at the size of 
+//	the pipeline divided by scale.
+//================================================
+struct PostPass {
+	Shader shader;
+	u8 scale;
+	vec2 direction;		//uploaded as "direction", the axis of the blur passes
+};
+
+//================================================
+//Description: An ordered list of passes applied 
+//	to the scene. All targets are created up 
+//	front and reused, running the pipeline never 
+//	allocates GPU memory.
+//================================================
+struct PostProcess {
+	u32 width;
+	u32 height;
+	bool follow_window;
+	Framebuffer scene;
+	Framebuffer targets[POST_SCALE_LEVELS][2];	//ping-pong pairs at full, half and quarter size
+	PostPass passes[POST_MAX_PASSES];
+	u32 passcount;
+	GLint previous_buffer;
+	GLint previous_viewport[4];
+};
+
+//==========================================================================================
+//Description: Creates an empty post-processing pipeline
+//
+//Parameters: 
+//		-(OPTIONAL) The size of the scene in pixels. 0 makes it the size of the window
+//			and recreates the targets whenever the window resizes (default = 0)
+//==========================================================================================
+PostProcess create_post_process(u32 width = 0, u32 height = 0);
+//==========================================================================================
+//Description: Appends a pass to a pipeline
+//
+//Parameters: 
+//		-A pipeline to add to
+//		-A shader from load_post_shader()
+//		-(OPTIONAL) POST_SCALE_FULL, POST_SCALE_HALF or POST_SCALE_QUARTER 
+//			(default = POST_SCALE_FULL)
+//
+//Comments: Passes at half size shade a quarter of the pixels, at quarter size a 
+//		sixteenth. Blurs and glows lose almost nothing at reduced size.
+//==========================================================================================
+void add_post_pass(PostProcess& post, Shader shader, u8 scale = POST_SCALE_FULL);
+//==========================================================================================
+//Description: Appends the built in passes. A downsample filters 16 texels with 4 bilinear
+//	samples, an upsample uses a 9 sample tent filter and a blur adds a horizontal and a
+//	vertical 9 tap gaussian pass (5 bilinear samples each).
+//==========================================================================================
+void add_downsample_pass(PostProcess& post, u8 scale = POST_SCALE_HALF);
+void add_upsample_pass(PostProcess& post, u8 scale = POST_SCALE_FULL);
+void add_blur_passes(PostProcess& post, u8 scale = POST_SCALE_HALF);
+//==========================================================================================
+//Description: Redirects drawing into the scene of a pipeline
+//
+//Comments: Call outside of begin2D and end2D. The scene is cleared with the clear color.
+//==========================================================================================
+void begin_post_process(PostProcess& post);
+//==========================================================================================
+//Description: Runs every pass and draws the result onto the framebuffer that was bound at
+//	begin_post_process (by default the window)
+//==========================================================================================
+void end_post_process(PostProcess& post);
+//==========================================================================================
+//Description: Compiles a fragment shader for a post-processing pass
+//
+//Comments: The shader receives in vec2 pass_uv and the uniforms sampler2D source (the
+//		output of the previous pass), sampler2D scene, vec2 texel (the size of a texel of
+//		source) and vec2 direction, and writes out vec4 outColor.
+//==========================================================================================
+Shader load_post_shader(const GLchar* fragmentstring);
+void dispose_post_process(PostProcess& post);
+
+#if defined(BMT_USE_NAMESPACE) 
+}
+#endif
+
+#endif
@@ -30,6 +30,7 @@
 #define RENDER2D_H
 
 #include "defines.h"
+#include "batch.h"
 #include "shader.h"
 #include "font.h"
 
@@ -37,22 +38,80 @@
 namespace bmt {
 #endif
 
+u32 inline rgba_to_u32(i32 r, i32 g, i32 b, i32 a) {
+	return a << 24 | b << 16 | g << 8 | r;
+}
+
+//Define BATCH_COMPACT_VERTICES (when building the library and your program) to pack the
+//2D vertex into 20 bytes instead of 44. Color becomes 8 bits per channel, texture 
+//coordinates become 16 bit fractions (so they can no longer go outside 0 to 1) and the
+//texture slot becomes a byte. BATCH_COMPACT_POSITIONS additionally stores positions as
+//16 bit integers (16 bytes per vertex), which limits coordinates to -32768 to 32767.
+//The default shader works unchanged with every layout.
+#if defined(BATCH_COMPACT_VERTICES)
+struct VertexData {
+#if defined(BATCH_COMPACT_POSITIONS)
+	i16 pos[2];
+#else
+	vec2 pos;
+#endif
+	u32 color;	//packed with rgba_to_u32
+	u16 uv[2];	//0 to 65535 maps to 0 to 1
+	u8 texid;
+	u8 shape_param;	//parameter of SDF shapes, see draw_circle
+	u8 depth;		//layer, see set_layer_2D
+	u8 blend;		//see set_blend_mode_2D
+};
+
+//normalized attributes arrive in the shader as 0 to 1 floats, the rest are converted as is
+BATCH_VERTEX_LAYOUT(VertexData,
+#if defined(BATCH_COMPACT_POSITIONS)
+	VERTEX_ATTRIB(VertexData, pos, "position", 2, GL_SHORT, GL_FALSE),
+#else
+	VERTEX_ATTRIB(VertexData, pos, "position", 2, GL_FLOAT, GL_FALSE),
+#endif
+	VERTEX_ATTRIB(VertexData, color, "color", 4, GL_UNSIGNED_BYTE, GL_TRUE),
+	VERTEX_ATTRIB(VertexData, uv, "uv", 2, GL_UNSIGNED_SHORT, GL_TRUE),
+	VERTEX_ATTRIB(VertexData, texid, "texid", 3, GL_UNSIGNED_BYTE, GL_FALSE),	//texture id, shape parameter, depth
+	VERTEX_ATTRIB(VertexData, blend, "blend", 1, GL_UNSIGNED_BYTE, GL_FALSE)
+);
+#else
 struct VertexData {
 	vec2 pos;
+	f32 depth;	//layer, see set_layer_2D
 	vec4 color; //32 bit color (8 for R, 8 for G, 8 for B, 8 for A)
 	vec2 uv;
 	f32 texid;
+	f32 blend;	//see set_blend_mode_2D
 };
 
-#ifndef BATCH_MAX_SPRITES
-#define BATCH_MAX_SPRITES	    20000
+BATCH_VERTEX_LAYOUT(VertexData,
+	VERTEX_ATTRIB(VertexData, pos, "position", 3, GL_FLOAT, GL_FALSE),	//position and depth
+	VERTEX_ATTRIB(VertexData, color, "color", 4, GL_FLOAT, GL_FALSE),
+	VERTEX_ATTRIB(VertexData, uv, "uv", 2, GL_FLOAT, GL_FALSE),
+	VERTEX_ATTRIB(VertexData, texid, "texid", 1, GL_FLOAT, GL_FALSE),
+	VERTEX_ATTRIB(VertexData, blend, "blend", 1, GL_FLOAT, GL_FALSE)
+);
 #endif
 
+//One sprite in the instanced pipeline (see load_instanced_shader_2D). The vertex shader
+//expands it into a rotated quad, so only 64 bytes per sprite are written and uploaded.
+struct InstanceData {
+	vec4 rect;		//x, y, width, height
+	vec4 transform;	//origin x, origin y (relative to x, y), rotation in radians, texture slot
+	vec4 uvs;		//left, top, right, bottom
+	u32 color;		//packed with rgba_to_u32
+	f32 depth;		//layer, see set_layer_2D
+	f32 blend;		//see set_blend_mode_2D
+	f32 _pad;
+};
+
+//blend modes of set_blend_mode_2D
+#define BLEND_ALPHA		0
+#define BLEND_ADDITIVE	1
+
 #define BATCH_VERTEX_SIZE	    sizeof(VertexData)
-#define BATCH_SPRITE_SIZE	    BATCH_VERTEX_SIZE * 4
-#define BATCH_BUFFER_SIZE	    BATCH_SPRITE_SIZE * BATCH_MAX_SPRITES
-#define BATCH_INDICE_SIZE	    BATCH_MAX_SPRITES * 6
-#define BATCH_MAX_TEXTURES		16
+#define BATCH_SPRITE_SIZE	    (BATCH_VERTEX_SIZE * 4)
 
 //==========================================================================================
 //Description: Initializes the 2D renderer with all the data it needs
@@ -60,8 +119,15 @@ struct VertexData {
 //Parameters: 
 //		-A rectangle (x, y, width, height) for the projection matrix (the viewport)
 //			of the render batch.
+//		-(OPTIONAL) How many sprites one batch holds before it is flushed 
+//			(default = BATCH_MAX_SPRITES)
+//
+//Comments: init_window() calls this with the default capacity. Calling it again
+//		afterwards rebuilds the batch buffers with the new capacity. Batches larger than
+//		16384 sprites switch to 32 bit indices. Drawing past the capacity never fails, 
+//		the batch is flushed and continues.
 //==========================================================================================
-void init2D(i32 x, i32 y, u32 width, u32 height);
+void init2D(i32 x, i32 y, u32 width, u32 height, u32 capacity = BATCH_MAX_SPRITES);
 //==========================================================================================
 //Description: Begins the renderer. You must do all draw calls in between
 //	begin2D and end2D.
@@ -71,8 +137,189 @@ void init2D(i32 x, i32 y, u32 width, u32 height);
 //			default shader.
 //		-(OPTIONAL) Whether or not to blend alpha (default = true)
 //		-(OPTIONAL) Whether or not to test depth (default = false)
+//		-(OPTIONAL) Whether to record draw calls and sort them before drawing 
+//			(default = false)
+//
+//Comments: With depth testing every sprite is drawn at the depth of its layer (see 
+//		set_layer_2D), higher layers in front. In sorted mode with depth testing, end2D()
+//		first draws the opaque sprites (see set_opaque_2D) front to back without blending,
+//		so the GPU can skip every pixel they hide, then blends the rest back to front.
+//		In sorted mode draw calls only record a command. end2D() sorts the commands
+//		by layer (see set_layer_2D), then texture, then call order, and draws them. Sprites
+//		that share a texture stay in call order, but sprites on the same layer with
+//		different textures may be reordered, so put anything that has to overlap in a
+//		particular way on separate layers. When several threads draw, the order between
+//		them is only the same every frame if each sets its own stream with 
+//		set_command_stream_2D().
+//		Passing a shader from load_instanced_shader_2D() switches the batch to the
+//		instanced pipeline, where each draw call writes one InstanceData record instead of
+//		four vertices. The draw functions are the same for both pipelines.
+//		Passing a shader from load_array_shader_2D() makes the batch sample layers of a
+//		TextureArray instead of 16 texture slots; it only flushes when the array changes.
+//==========================================================================================
+void begin2D(Shader shader, bool blending = true, bool depthTest = false, bool sorted = false);
+//==========================================================================================
+//Description: Sets the layer following draw calls are on. Higher layers are drawn on top of 
+//	lower ones. begin2D() resets the layer to 0.
+//
+//Comments: Orders draws in sorted mode, and sets their depth when depth testing. Without
+//		either it has no effect. The layer is kept per thread.
+//==========================================================================================
+void set_layer_2D(u8 layer);
+//==========================================================================================
+//Description: Marks following textured draw calls as opaque (every pixel of the texture
+//	area fully covers what is behind it). begin2D() resets it to false.
+//
+//Comments: Only used in sorted mode with depth testing. Untextured rectangles with full 
+//		alpha are always treated as opaque, shapes and translucent colors never are.
+//==========================================================================================
+void set_opaque_2D(bool opaque);
+//==========================================================================================
+//Description: Sets how following draw calls blend, BLEND_ALPHA or BLEND_ADDITIVE. 
+//	begin2D() resets it to BLEND_ALPHA.
+//
+//Comments: The default shaders write premultiplied colors and blend with GL_ONE, 
+//		GL_ONE_MINUS_SRC_ALPHA, which covers both modes (an additive sprite writes an alpha
+//		of 0), so alpha and additive sprites mix in one batch without flushing. Custom
+//		shaders only get this if they read the blend attribute (instance_blend for
+//		instanced shaders) the way the default ones do. The mode is kept per thread.
+//==========================================================================================
+void set_blend_mode_2D(u8 mode);
+//==========================================================================================
+//Description: Clips following draw calls to an area (in the coordinates sprites are drawn
+//	in) until the matching pop_clip_rect(). Nested areas are clipped to the ones around 
+//	them. begin2D() empties the stack.
+//
+//Comments: Clipping happens as sprites are written, so clipped and unclipped draws share
+//		a batch. Axis-aligned sprites are shrunk along with their texture coordinates, 
+//		rotated sprites and meshes have their polygon cut. The instanced shaders can only 
+//		clip sprites that are not rotated, and sprite layers are never clipped. The stack
+//		is kept per thread.
+//==========================================================================================
+void push_clip_rect(Rect area);
+void pop_clip_rect();
+//==========================================================================================
+//Description: Orders the draw calls the calling thread records in sorted mode against the
+//	other threads'. end2D() merges the threads' commands by stream before sorting, so 
+//	giving every worker its own stream (its job index, for example) makes the result the 
+//	same no matter how the threads were scheduled.
+//
+//Comments: In sorted mode any thread can call the draw functions between begin2D and 
+//		end2D. Each thread builds its sprites' vertices into its own staging buffer, the GL
+//		thread only copies them into the batch in sorted order and draws. Workers must be 
+//		done recording before end2D() or draw_sprite_layer() is called. Threads sharing
+//		a stream are merged in the order they first recorded. Defaults to 0, and goes back
+//		to 0 for a thread that did not call any 2D function during the previous pass.
+//==========================================================================================
+void set_command_stream_2D(u32 stream);
+//==========================================================================================
+//Description: Turns view culling on or off (default = off). While on, every draw call 
+//	whose sprite lies entirely outside the cull rect is dropped before it reaches the batch.
+//
+//Comments: Rotated sprites are tested with a conservative bound, so some that are just 
+//		off screen are still drawn. Nothing that is on screen is ever dropped.
+//==========================================================================================
+void set_culling_2D(bool enabled);
+//==========================================================================================
+//Description: Sets the area (in the coordinates sprites are drawn in) that is visible. 
+//	init2D() sets it to its viewport rectangle.
+//
+//Comments: If you move the view with a view matrix, move the cull rect along with it.
+//==========================================================================================
+void set_cull_rect_2D(Rect area);
+Rect get_cull_rect_2D();
+
+//================================================
+//Description: A view onto the 2D world, applied 
+//	by the vertex shader's view matrix so sprites
+//	are written (and cached) in world space.
+//================================================
+struct Camera2D {
+	vec2 position;	//world point at the center of the view
+	f32 zoom;		//2 draws the world twice as large
+	f32 rotation;	//degrees, the world turns the other way on screen
+};
+
+Camera2D create_camera_2D(f32 x, f32 y, f32 zoom = 1, f32 rotation = 0);
+//==========================================================================================
+//Description: Returns the view matrix of a camera, mapping world space onto the area 
+//	init2D() was given
+//==========================================================================================
+mat4 camera_view_matrix_2D(const Camera2D& camera);
+vec2 world_to_screen_2D(const Camera2D& camera, vec2 point);
+vec2 screen_to_world_2D(const Camera2D& camera, vec2 point);
+//==========================================================================================
+//Description: Returns the area of the world a camera sees (the box around it when rotated),
+//	for example to pass to draw_tilemap()
+//==========================================================================================
+Rect get_camera_rect_2D(const Camera2D& camera);
+//==========================================================================================
+//Description: Makes following draw calls go through a camera. Every begin2D() uploads its
+//	view matrix to the shader's view uniform and sets the cull rect to what it sees.
+//
+//Comments: Called between begin2D and end2D it draws what was batched so far first, so 
+//		the world and the screen-space UI (see reset_camera_2D) can be drawn in the same 
+//		pass. Nothing is transformed on the CPU, so sprite layers, render layers and 
+//		tilemap chunks survive camera motion without being rebuilt or uploaded again.
+//==========================================================================================
+void set_camera_2D(const Camera2D& camera);
+//==========================================================================================
+//Description: Goes back to drawing in screen space: uploads an identity view and sets the 
+//	cull rect back to the area init2D() was given
+//==========================================================================================
+void reset_camera_2D();
+
+//number of frames of Render2DStats kept for get_render_stats_history_2D()
+#ifndef RENDER_STATS_HISTORY
+#define RENDER_STATS_HISTORY	240
+#endif
+
+struct Render2DStats {
+	u32 passes;				//begin2D calls (shader switches)
+	u32 drawcalls;			//including sprite layers
+	u32 flushes_textures;	//flushes forced by running out of texture slots or changing texture arrays
+	u32 flushes_capacity;	//flushes forced by a full batch
+	u32 flushes_explicit;	//any other flush of a non-empty batch: end2D, camera changes, sorted depth passes,
+							//sprite layers and render layers
+	u32 quads;
+	u32 emitted;			//sprites that reached the batch
+	u32 culled;				//sprites dropped by view culling
+	u64 bytes_uploaded;
+	u32 textures;			//distinct textures drawn from
+	f32 emit_ms;			//CPU time spent writing vertices (needs set_render_timing_2D)
+	f32 gpu_ms;				//GPU time of the 2D draws (needs set_render_timing_2D), -1 if not known yet
+};
+
+//==========================================================================================
+//Description: Returns the 2D stats of the last finished frame
+//
+//Comments: GPU timers are read back a few frames late so they never stall, gpu_ms is the
+//		most recent frame whose timers had finished.
+//==========================================================================================
+Render2DStats get_render_stats_2D();
 //==========================================================================================
-void begin2D(Shader shader, bool blending = true, bool depthTest = false);
+//Description: Returns the 2D stats of the frame so far, for example right after end2D()
+//==========================================================================================
+Render2DStats get_frame_stats_2D();
+//==========================================================================================
+//Description: Turns CPU and GPU timing of the 2D renderer on or off (default = off)
+//
+//Comments: The GPU timers need OpenGL 3.3 or ARB_timer_query.
+//==========================================================================================
+void set_render_timing_2D(bool enabled);
+//==========================================================================================
+//Description: Copies the stats of up to the last RENDER_STATS_HISTORY frames, oldest 
+//	first, and returns how many were copied.
+//==========================================================================================
+u32 get_render_stats_history_2D(Render2DStats* stats, u32 count);
+//==========================================================================================
+//Description: Writes the stats history to a CSV file, one frame per line
+//==========================================================================================
+void dump_render_stats_2D(const char* filepath);
+//==========================================================================================
+//Description: Ends the frame for the 2D counters. end_drawing() calls this.
+//==========================================================================================
+void end_frame_2D();
 //==========================================================================================
 //Description: Draws a texture onto the bound framebuffer (by default the window)
 //
@@ -153,6 +400,79 @@ void draw_texture_EX(Texture tex, Rect source, Rect dest);
 void draw_texture_EX(Texture tex, Rect source, Rect dest, f32 r, f32 g, f32 b, f32 a);
 void draw_texture_EX(Texture tex, Rect source, Rect dest, vec4 color);
 void draw_texture_EX(Texture tex, Rect source, Rect dest, vec2 origin);
+
+#define SPRITE_MESH_MAX_POINTS	8
+
+//================================================
+//Description: A convex polygon around the opaque
+//	pixels of a texture. Drawing a sprite with it 
+//	skips the transparent corners a quad would 
+//	shade. Points are 0 to 1 across the texture.
+//================================================
+struct SpriteMesh {
+	vec2 points[SPRITE_MESH_MAX_POINTS];
+	u32 count;		//0 when trimming saves nothing, the sprite is then drawn as a quad
+};
+
+//==========================================================================================
+//Description: Computes the convex polygon (up to SPRITE_MESH_MAX_POINTS points) that holds
+//	every pixel with an alpha above threshold
+//
+//Parameters: 
+//		-RGBA pixels and their size, or a texture to read the pixels back from
+//		-(OPTIONAL) The alpha (0 to 255) a pixel needs to be kept (default = 0)
+//
+//Comments: Meant to run once at load time, reading a texture back stalls the GPU. The 
+//		polygon is the convex hull of the kept pixels, with the edges whose removal adds
+//		the least area collapsed until it has few enough points. It never leaves the 
+//		texture.
+//==========================================================================================
+SpriteMesh create_sprite_mesh(const unsigned char* pixels, u32 width, u32 height, u8 threshold = 0);
+SpriteMesh create_sprite_mesh(Texture tex, u8 threshold = 0);
+//==========================================================================================
+//Description: Draws a texture clipped to its sprite mesh
+//
+//Parameters: 
+//		-A texture and its mesh from create_sprite_mesh()
+//		-A square area to draw onto
+//		-(OPTIONAL) A degree to rotate by, about the center of dest (default = 0)
+//		-(OPTIONAL) A color(RGBA) to multiply with (default = white)
+//
+//Comments: Meshes are batched with quads. Batches holding a mesh stream their indices
+//		instead of using the static quad indices. The instanced pipeline draws meshes as 
+//		quads. In sorted mode the mesh is read at end2D(), so it has to live until then.
+//==========================================================================================
+void draw_texture_mesh(Texture tex, const SpriteMesh& mesh, i32 xPos, i32 yPos);
+void draw_texture_mesh(Texture tex, const SpriteMesh& mesh, Rect dest, f32 rotation = 0, vec4 color = V4(255, 255, 255, 255));
+//================================================
+//Description: One sprite for draw_sprites(). The 
+//	sprite is rotated about its center.
+//================================================
+struct SpriteInstance {
+	const Texture* tex;	//NULL for a flat colored quad
+	f32 x;
+	f32 y;
+	f32 width;
+	f32 height;
+	f32 rotation;		//degrees
+	vec4 color;			//RGBA, 0 to 255
+};
+
+//==========================================================================================
+//Description: Draws many sprites in one call
+//
+//Parameters: 
+//		-An array of sprites
+//		-The number of sprites in the array
+//
+//Comments: Meant for particles and other large groups of sprites. With SSE2 (see 
+//		BMT_SSE2 in defines.h) four sprites are rotated at a time using an approximate
+//		sine and cosine (error below 0.001) and written to the batch with streaming 
+//		stores. Consecutive sprites with the same texture skip the texture lookup. In
+//		sorted mode, with the instanced pipeline or without SSE2 every sprite goes through
+//		the regular draw path.
+//==========================================================================================
+void draw_sprites(const SpriteInstance* sprites, u32 count);
 //==========================================================================================
 //Description: Draws a framebuffer onto another bound framebuffer (by default the window)
 //
@@ -175,6 +495,24 @@ void draw_framebuffer(Framebuffer buffer, i32 xPos, i32 yPos);
 void draw_rectangle(i32 x, i32 y, i32 width, i32 height, f32 r, f32 g, f32 b, f32 a);
 void draw_rectangle(i32 x, i32 y, i32 width, i32 height, vec4 color);
 //==========================================================================================
+//Description: Draws antialiased shapes onto the bound framebuffer (by default the window)
+//
+//Parameters: 
+//		-draw_circle: a center, a radius and a color(RGBA)
+//		-draw_ring: a center, a radius, how thick the ring is (inwards from the radius) 
+//			and a color(RGBA)
+//		-draw_rounded_rectangle: an x, y, width, height, a corner radius and a color(RGBA)
+//		-draw_line: two end points, a thickness and a color(RGBA). Lines have round caps.
+//
+//Comments: Every shape is a single quad whose fragment shader evaluates a signed distance
+//		function, so shapes go into the same batch and draw call as sprites. Custom shaders
+//		have to decode shapes the way the default shaders do to draw them.
+//==========================================================================================
+void draw_circle(f32 x, f32 y, f32 radius, vec4 color);
+void draw_ring(f32 x, f32 y, f32 radius, f32 thickness, vec4 color);
+void draw_rounded_rectangle(i32 x, i32 y, i32 width, i32 height, f32 radius, vec4 color);
+void draw_line(f32 x1, f32 y1, f32 x2, f32 y2, f32 thickness, vec4 color);
+//==========================================================================================
 //Description: Draws a string onto the bound framebuffer (by default the window)
 //
 //Parameters: 
@@ -191,17 +529,212 @@ void draw_text(Font& font, std::string str, i32 xPos, i32 yPos, f32 r = 255.0f,
 //===============================================================================
 void end2D();
 
+//================================================
+//Description: A retained set of sprites with its 
+//	own GPU buffer. Sprites are added once and only
+//	re-uploaded when they change, and the whole 
+//	layer is drawn with one draw call. Suited for 
+//	backgrounds and props that rarely move.
+//================================================
+struct SpriteLayer {
+	GLuint vao;
+	GLuint vbo;
+	GLuint ebo;
+	u32 count;		//sprite slots in use, including removed ones waiting in freelist
+	u32 capacity;
+	GLuint textures[BATCH_MAX_TEXTURES];
+	u16 texcount;
+	std::vector<VertexData> vertices;
+	std::vector<u8> dirty;
+	std::vector<u8> alive;	//the slot holds a sprite, removed handles are not updated or removed again
+	std::vector<u32> dirtylist;
+	std::vector<u32> freelist;
+};
+
+//==========================================================================================
+//Description: Creates an empty sprite layer
+//
+//Parameters: 
+//		-How many sprites to make room for. The layer grows if more are added.
+//==========================================================================================
+SpriteLayer create_sprite_layer(u32 capacity);
+//==========================================================================================
+//Description: Adds a sprite to a layer and returns a handle to it
+//
+//Parameters: 
+//		-A layer to add to
+//		-A texture, and optionally a square area of it to draw
+//		-A square area to draw onto
+//		-(OPTIONAL) A color(RGBA) to multiply with (default = white)
+//		-(OPTIONAL) A degree to rotate by, about the center of dest (default = 0)
+//
+//Comments: A layer can use up to BATCH_MAX_TEXTURES textures (an atlas counts as one).
+//		Handles of removed sprites are reused by later adds. Updating or removing a 
+//		handle that was already removed only logs a warning.
+//==========================================================================================
+u32 add_layer_sprite(SpriteLayer& layer, Texture tex, Rect dest, vec4 color = V4(255, 255, 255, 255), f32 rotation = 0);
+u32 add_layer_sprite(SpriteLayer& layer, Texture tex, Rect source, Rect dest, vec4 color = V4(255, 255, 255, 255), f32 rotation = 0);
+void update_layer_sprite(SpriteLayer& layer, u32 handle, Texture tex, Rect dest, vec4 color = V4(255, 255, 255, 255), f32 rotation = 0);
+void update_layer_sprite(SpriteLayer& layer, u32 handle, Texture tex, Rect source, Rect dest, vec4 color = V4(255, 255, 255, 255), f32 rotation = 0);
+void remove_layer_sprite(SpriteLayer& layer, u32 handle);
+//==========================================================================================
+//Description: Uploads the sprites that changed since the last draw and draws the layer
+//
+//Comments: Must be called between begin2D and end2D with a shader from 
+//		load_default_shader_2D() (or a custom shader using the same vertex layout). Sprites
+//		drawn before the layer stay underneath it.
+//==========================================================================================
+void draw_sprite_layer(SpriteLayer& layer);
+void dispose_sprite_layer(SpriteLayer& layer);
+
+//================================================
+//Description: An offscreen target that caches 2D
+//	draws. The draws are only redone when the 
+//	layer is dirty, otherwise the cached texture
+//	is drawn with one quad. Suited for HUDs and 
+//	backgrounds that change a few times a second.
+//================================================
+struct RenderLayer {
+	Framebuffer buffer;
+	u32 width;
+	u32 height;
+	bool follow_window;			//sized to the window, recreated when it resizes
+	bool invalidate_on_resize;
+	bool dirty;
+	i32 window_width;			//window size the layer was last drawn at
+	i32 window_height;
+	GLint previous_buffer;
+	GLint previous_viewport[4];
+};
+
+//==========================================================================================
+//Description: Creates a render layer, dirty so its first begin_render_layer records
+//
+//Parameters: 
+//		-(OPTIONAL) The size of the layer in pixels. 0 makes the layer the size of the
+//			window and recreates it whenever the window resizes (default = 0)
+//		-(OPTIONAL) Whether resizing the window marks the layer dirty (default = true)
+//==========================================================================================
+RenderLayer create_render_layer(u32 width = 0, u32 height = 0, bool invalidate_on_resize = true);
+//==========================================================================================
+//Description: Starts redrawing a render layer if it is dirty. Returns whether it is, and 
+//	only then are the following 2D passes drawn into the layer.
+//
+//Comments: Call outside of begin2D and end2D, and call end_render_layer() when it returns
+//		true. The layer is cleared to transparent before drawing, and is drawn with the 
+//		projection you uploaded to your shader, so a layer the size of the window lines up
+//		with the screen.
+//
+//		if (begin_render_layer(hud)) {
+//			begin2D(shader);
+//			//draw the hud
+//			end2D();
+//			end_render_layer(hud);
+//		}
+//==========================================================================================
+bool begin_render_layer(RenderLayer& layer);
+void end_render_layer(RenderLayer& layer);
+//==========================================================================================
+//Description: Marks a render layer dirty, so it is redrawn at the next begin_render_layer
+//==========================================================================================
+void invalidate_render_layer(RenderLayer& layer);
+//==========================================================================================
+//Description: Draws the cached contents of a render layer
+//
+//Comments: Must be called between begin2D and end2D, not with the array shader. Sprites 
+//		drawn before the layer stay underneath it.
+//==========================================================================================
+void draw_render_layer(RenderLayer& layer, i32 xPos = 0, i32 yPos = 0);
+void dispose_render_layer(RenderLayer& layer);
+
+//how many frames in a row have to hit the target before the scale is probed upwards
+#ifndef DYNAMIC_RESOLUTION_PROBE_FRAMES
+#define DYNAMIC_RESOLUTION_PROBE_FRAMES	60
+#endif
+
+//================================================
+//Description: An offscreen target for the scene 
+//	that renders at a fraction of the window 
+//	size, adjusted every frame to hold a target 
+//	frame time, and is upscaled to the window.
+//================================================
+struct DynamicResolution {
+	Framebuffer buffer;		//window sized, the scene uses the bottom left scale x scale of it
+	u32 width;
+	u32 height;
+	f32 scale;
+	f32 min_scale;
+	f32 max_scale;
+	f64 target_time;
+	f64 smoothed_time;
+	u32 stable_frames;
+	u32 scaled_width;
+	u32 scaled_height;
+	GLint previous_buffer;
+	GLint previous_viewport[4];
+};
+
+//==========================================================================================
+//Description: Creates a dynamic resolution target the size of the window
+//
+//Parameters: 
+//		-(OPTIONAL) The frame rate to hold (default = 60)
+//		-(OPTIONAL) The smallest and largest fraction of the window size to render the 
+//			scene at (default = 0.5 to 1)
+//==========================================================================================
+DynamicResolution create_dynamic_resolution(f32 target_fps = 60, f32 min_scale = 0.5f, f32 max_scale = 1.0f);
+//==========================================================================================
+//Description: Adjusts the scale from get_frame_time() and redirects drawing into the 
+//	scaled target
+//
+//Comments: Call outside of begin2D and end2D. Draw the scene with the same projection as
+//		always, it is scaled down by the viewport. Draw the target with 
+//		draw_dynamic_resolution() after end_dynamic_resolution(), and the UI after that
+//		to keep it at the native resolution.
+//
+//		The cost of a frame grows with the area, so the scale moves by the square root 
+//		of how far the smoothed frame time is off the target. With vsync frames never 
+//		finish early, so after DYNAMIC_RESOLUTION_PROBE_FRAMES frames on target the 
+//		scale is raised a little to find out whether it can go back up.
+//==========================================================================================
+void begin_dynamic_resolution(DynamicResolution& res);
+void end_dynamic_resolution(DynamicResolution& res);
+//==========================================================================================
+//Description: Draws the scene of a dynamic resolution target stretched over the window
+//
+//Comments: Must be called between begin2D and end2D.
+//==========================================================================================
+void draw_dynamic_resolution(DynamicResolution& res);
+void dispose_dynamic_resolution(DynamicResolution& res);
+
 f32 get_blackbar_width(f32 aspect);
 f32 get_blackbar_height(f32 aspect);
 Rect fit_aspect_ratio(f32 aspect);
 Shader load_default_shader_2D();
+//==========================================================================================
+//Description: Loads the default shader for the instanced 2D pipeline
+//
+//Comments: Needs OpenGL 3.3 or ARB_instanced_arrays. Custom instanced shaders must
+//		declare the vec4 inputs instance_rect, instance_transform, instance_uvs and 
+//		instance_color and the floats instance_depth and instance_blend (see InstanceData)
+//		and be bound to locations 0 to 5.
+//==========================================================================================
+Shader load_instanced_shader_2D();
+//==========================================================================================
+//Description: Loads the shader for drawing layers of a TextureArray
+//
+//Parameters: 
+//		-(OPTIONAL) Whether to use the instanced pipeline (default = false)
+//
+//Comments: Every textured sprite in the batch must come from the same TextureArray to 
+//		stay in one draw call. Textures that are not array layers are drawn untextured.
+//		With BATCH_COMPACT_VERTICES only layers 0 to 254 can be addressed, higher layers
+//		are drawn untextured.
+//==========================================================================================
+Shader load_array_shader_2D(bool instanced = false);
 
 void dispose2D();
 
-u32 inline rgba_to_u32(i32 r, i32 g, i32 b, i32 a) {
-	return a << 24 | b << 16 | g << 8 | r;
-}
-
 #if defined(BMT_USE_NAMESPACE) 
 }
 #endif
@@ -83,6 +83,11 @@ bool is_key_up(unsigned int keycode);
 bool is_button_up(unsigned int button);
 
 double get_elapsed_time();
+//==========================================================================================
+//Description: Returns how long the last frame took in seconds (updating and drawing), not
+//	counting the wait added by set_FPS_cap()
+//==========================================================================================
+double get_frame_time();
 
 void get_mouse_pos(double* mousexPtr, double* mouseyPtr);
 vec2 get_mouse_pos();
@@ -30,14 +30,18 @@
 #define BAHAMUT_H
 
 #include "audio.h"
+#include "batch.h"
 #include "defines.h"
 #include "entity.h"
 #include "font.h"
+#include "lighting.h"
 #include "maths.h"
+#include "postprocess.h"
 #include "render2D.h"
 #include "render3D.h"
 #include "shader.h"
 #include "texture.h"
+#include "tilemap.h"
 #include "window.h"
 
 #if defined(BMT_USE_NAMESPACE) 
@@ -50,6 +50,12 @@ namespace bmt {
 #define GLOBAL   extern
 #define MAX_FORMAT_TEXT_SIZE 128
 
+//SSE2 is always there on x64, 32 bit builds have to ask for it (/arch:SSE2 or -msse2).
+//Define BMT_NO_SIMD to force the scalar code paths.
+#if !defined(BMT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define BMT_SSE2
+#endif
+
 #define BMT_TO_STRING(x) #x
 #define BMT_STRING_APPEND(str1, str2) str1 ## str2
 
@@ -82,6 +82,11 @@ Font load_font(const GLchar* filepath, unsigned int size) {
 		character->texture.width = font.face->glyph->bitmap.width;
 		character->texture.height = font.face->glyph->bitmap.rows;
 		character->texture.flip_flag = 0;
+		character->texture.target = GL_TEXTURE_2D;
+		character->texture.layer = 0;
+		character->texture.region = rect(0, 0, 0, 0);
+		character->texture.premultiplied = false;
+		character->texture.atlas = NULL;
 
 		GLubyte* glyphPixels = font.face->glyph->bitmap.buffer;
 
@@ -145,6 +150,11 @@ Texture create_texture_from_string(Font& font, const std::string str, GLubyte r,
 	tex.width = w;
 	tex.height = h;
 	tex.flip_flag = 0;
+	tex.target = GL_TEXTURE_2D;
+	tex.layer = 0;
+	tex.region = rect(0, 0, 0, 0);
+	tex.premultiplied = false;
+	tex.atlas = NULL;
 
 	glActiveTexture(GL_TEXTURE0);
 	glGenTextures(1, &tex.ID);
@@ -0,0 +1,364 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                      lighting.cpp                               //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2018 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#include "lighting.h"
+#include "postprocess.h"
+#include "window.h"
+#include <algorithm>
+
+#if defined(BMT_USE_NAMESPACE) 
+namespace bmt {
+#endif
+
+const GLchar* LIGHT_VERT_SHADER = R"FOO(
+#version 130
+in vec2 position;
+in vec2 local;
+in vec4 color;
+in vec4 cone;
+
+out vec2 pass_local;
+out vec4 pass_color;
+out vec4 pass_cone;
+
+uniform mat4 projection = mat4(1.0);
+uniform mat4 view = mat4(1.0);
+
+void main() {
+	pass_local = local;
+	pass_color = color;
+	pass_cone = cone;
+	gl_Position = projection * view * vec4(position, 1.0, 1.0);
+	gl_Position.z = 0.0;
+}
+
+)FOO";
+
+const GLchar* LIGHT_FRAG_SHADER = R"FOO(
+#version 130
+out vec4 outColor;
+in vec2 pass_local;
+in vec4 pass_color;
+in vec4 pass_cone;
+
+void main() {
+	float dist = length(pass_local);
+	float falloff = clamp(1.0 - dist, 0.0, 1.0);
+	falloff *= falloff;
+	//cones fade out over their soft edge, point lights have a cone no direction falls outside
+	float facing = dot(pass_local / max(dist, 0.0001), pass_cone.xy);
+	float edge = smoothstep(pass_cone.z, pass_cone.z + pass_cone.w, facing);
+	outColor = vec4(pass_color.rgb * pass_color.a * falloff * edge, 1.0);
+}
+
+)FOO";
+
+const GLchar* LIGHT_COMPOSITE_FRAG_SHADER = R"FOO(
+#version 130
+out vec4 outColor;
+in vec2 pass_uv;
+uniform sampler2D source;
+
+void main() {
+	outColor = vec4(texture(source, pass_uv).rgb, 1.0);
+}
+
+)FOO";
+
+//the shaders and the empty vertex array of the composite pass are shared by every light map
+INTERNAL u32 light_users;
+INTERNAL GLuint light_vao;
+INTERNAL Shader light_shader;
+INTERNAL Shader composite_shader;
+
+//==========================================================================================
+//Description: Creates the light buffer, linearly filtered so it is smoothly scaled back up
+//==========================================================================================
+INTERNAL
+void create_light_buffer(LightMap& lights) {
+	u32 width = lights.width / lights.scale;
+	u32 height = lights.height / lights.scale;
+	lights.buffer = create_framebuffer(width > 0 ? width : 1, height > 0 ? height : 1, GL_LINEAR, COLORBUFFER);
+	glBindTexture(GL_TEXTURE_2D, lights.buffer.texture.ID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+LightMap create_light_map(u32 width, u32 height, u8 scale) {
+	LightMap lights = {};
+	lights.follow_window = width == 0 || height == 0;
+	lights.width = lights.follow_window ? get_window_width() : width;
+	lights.height = lights.follow_window ? get_window_height() : height;
+	lights.scale = (scale > 0) ? scale : 1;
+	lights.ambient = V4(0, 0, 0, 1);
+	create_light_buffer(lights);
+	lights.batch = create_batch<LightVertex>(LIGHT_BATCH_SIZE);
+
+	if (light_users++ == 0) {
+		glGenVertexArrays(1, &light_vao);
+		light_shader = load_shader_2D_from_strings(LIGHT_VERT_SHADER, LIGHT_FRAG_SHADER);
+		composite_shader = load_post_shader(LIGHT_COMPOSITE_FRAG_SHADER);
+	}
+	return lights;
+}
+
+void set_ambient_light(LightMap& lights, vec4 color) {
+	lights.ambient = V4(color.x / 255.0f, color.y / 255.0f, color.z / 255.0f, color.w / 255.0f);
+}
+
+void add_light_occluder(LightMap& lights, Rect area) {
+	lights.occluders.push_back(area);
+}
+
+void clear_light_occluders(LightMap& lights) {
+	lights.occluders.clear();
+}
+
+void begin_lights(LightMap& lights, mat4 projection, mat4 view) {
+	if (lights.follow_window) {
+		i32 width = get_window_width();
+		i32 height = get_window_height();
+		//a minimized window reports 0, keep the old buffer until it comes back
+		if (width > 0 && height > 0 && ((u32)width != lights.width || (u32)height != lights.height)) {
+			lights.width = width;
+			lights.height = height;
+			dispose_framebuffer(lights.buffer);
+			create_light_buffer(lights);
+		}
+	}
+
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &lights.previous_buffer);
+	glGetIntegerv(GL_VIEWPORT, lights.previous_viewport);
+	lights.previous_blending = glIsEnabled(GL_BLEND);
+	lights.previous_depth = glIsEnabled(GL_DEPTH_TEST);
+
+	bind_framebuffer(lights.buffer);
+	glViewport(0, 0, lights.buffer.texture.width, lights.buffer.texture.height);
+	GLfloat clear_color[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+	glClearColor(lights.ambient.x, lights.ambient.y, lights.ambient.z, 1);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+
+	//lights add up, the buffer only ever holds how lit each pixel is
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	glDisable(GL_DEPTH_TEST);
+	begin_batch(lights.batch, light_shader);
+	upload_mat4(light_shader, "projection", projection);
+	upload_mat4(light_shader, "view", view);
+}
+
+INTERNAL inline
+void write_light_vertex(LightVertex* vertex, vec2 pos, vec2 center, f32 radius, vec4 color, vec4 cone) {
+	vertex->pos = pos;
+	vertex->local = V2((pos.x - center.x) / radius, (pos.y - center.y) / radius);
+	vertex->color = color;
+	vertex->cone = cone;
+}
+
+//==========================================================================================
+//Description: Returns how far a ray goes before it hits one of the segments (stored as 
+//	pairs of points), or FLT_MAX if it hits none
+//==========================================================================================
+INTERNAL
+f32 cast_light_ray(vec2 origin, vec2 dir, const std::vector<vec2>& segments) {
+	f32 nearest = FLT_MAX;
+	for (u32 i = 0; i + 1 < segments.size(); i += 2) {
+		vec2 a = segments[i];
+		vec2 edge = V2(segments[i + 1].x - a.x, segments[i + 1].y - a.y);
+		f32 denom = dir.x * edge.y - dir.y * edge.x;
+		if (fabs(denom) < 0.000001f)
+			continue;
+		vec2 d = V2(a.x - origin.x, a.y - origin.y);
+		f32 t = (d.x * edge.y - d.y * edge.x) / denom;
+		f32 u = (d.x * dir.y - d.y * dir.x) / denom;
+		if (t >= 0 && u >= 0 && u <= 1 && t < nearest)
+			nearest = t;
+	}
+	return nearest;
+}
+
+struct LightHit {
+	f32 angle;
+	vec2 point;
+};
+
+INTERNAL
+bool compare_light_hits(const LightHit& first, const LightHit& second) {
+	return first.angle < second.angle;
+}
+
+INTERNAL
+void add_occluder_segments(std::vector<vec2>& segments, Rect area) {
+	vec2 corners[4] = {
+		V2(area.x, area.y), V2(area.x + area.width, area.y),
+		V2(area.x + area.width, area.y + area.height), V2(area.x, area.y + area.height)
+	};
+	for (u32 i = 0; i < 4; ++i) {
+		segments.push_back(corners[i]);
+		segments.push_back(corners[(i + 1) % 4]);
+	}
+}
+
+//==========================================================================================
+//Description: Adds a light to the batch. Without occluders in reach it is one quad, with
+//	them it is the polygon the light can see, found by casting rays just before, at and 
+//	just after every corner in reach, drawn as a fan of degenerate quads.
+//==========================================================================================
+INTERNAL
+void push_light(LightMap& lights, vec2 pos, f32 radius, vec4 color, vec4 cone, bool shadows) {
+	if (radius <= 0)
+		return;
+	color = V4(color.x / 255.0f, color.y / 255.0f, color.z / 255.0f, color.w / 255.0f);
+	Rect reach = rect(pos.x - radius, pos.y - radius, radius * 2, radius * 2);
+
+	std::vector<vec2> segments;
+	if (shadows) {
+		for (u32 i = 0; i < lights.occluders.size(); ++i) {
+			if (colliding(lights.occluders[i], reach))
+				add_occluder_segments(segments, lights.occluders[i]);
+		}
+	}
+
+	if (segments.size() == 0) {
+		LightVertex* quad = push_quad(lights.batch);
+		write_light_vertex(quad + 0, V2(reach.x, reach.y), pos, radius, color, cone);
+		write_light_vertex(quad + 1, V2(reach.x, reach.y + reach.height), pos, radius, color, cone);
+		write_light_vertex(quad + 2, V2(reach.x + reach.width, reach.y + reach.height), pos, radius, color, cone);
+		write_light_vertex(quad + 3, V2(reach.x + reach.width, reach.y), pos, radius, color, cone);
+		return;
+	}
+
+	//the edges of the light's reach stop every ray that misses the occluders
+	add_occluder_segments(segments, reach);
+	std::vector<LightHit> hits;
+	for (u32 i = 0; i < segments.size(); i += 2) {
+		f32 angle = atan2(segments[i].y - pos.y, segments[i].x - pos.x);
+		for (i32 side = -1; side <= 1; ++side) {
+			LightHit hit;
+			hit.angle = angle + side * 0.0001f;
+			vec2 dir = V2(cos(hit.angle), sin(hit.angle));
+			f32 dist = cast_light_ray(pos, dir, segments);
+			if (dist == FLT_MAX)
+				continue;
+			hit.point = V2(pos.x + dir.x * dist, pos.y + dir.y * dist);
+			hits.push_back(hit);
+		}
+	}
+	std::sort(hits.begin(), hits.end(), compare_light_hits);
+
+	for (u32 i = 0; i < hits.size(); ++i) {
+		vec2 next = hits[(i + 1) % hits.size()].point;
+		LightVertex* quad = push_quad(lights.batch);
+		write_light_vertex(quad + 0, pos, pos, radius, color, cone);
+		write_light_vertex(quad + 1, hits[i].point, pos, radius, color, cone);
+		write_light_vertex(quad + 2, next, pos, radius, color, cone);
+		write_light_vertex(quad + 3, next, pos, radius, color, cone);
+	}
+}
+
+void draw_point_light(LightMap& lights, vec2 pos, f32 radius, vec4 color, bool shadows) {
+	//a cone no direction falls outside of
+	push_light(lights, pos, radius, color, V4(1, 0, -2, 0.5f), shadows);
+}
+
+void draw_cone_light(LightMap& lights, vec2 pos, f32 radius, f32 direction, f32 angle, vec4 color, bool shadows) {
+	if (angle >= 360) {
+		draw_point_light(lights, pos, radius, color, shadows);
+		return;
+	}
+	f32 dir = deg_to_rad(direction);
+	f32 half = deg_to_rad(angle) / 2;
+	//the outer fifth of the cone fades out
+	f32 inner = cos(half * 0.8f);
+	f32 outer = cos(half);
+	push_light(lights, pos, radius, color, V4(cos(dir), sin(dir), outer, fmax(inner - outer, 0.001f)), shadows);
+}
+
+//==========================================================================================
+//Description: Puts back the framebuffer, viewport and blend state from before begin_lights
+//==========================================================================================
+INTERNAL
+void restore_light_state(LightMap& lights) {
+	glBindFramebuffer(GL_FRAMEBUFFER, lights.previous_buffer);
+	glViewport(lights.previous_viewport[0], lights.previous_viewport[1], lights.previous_viewport[2], lights.previous_viewport[3]);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	if (!lights.previous_blending)
+		glDisable(GL_BLEND);
+	if (lights.previous_depth)
+		glEnable(GL_DEPTH_TEST);
+}
+
+void end_lights(LightMap& lights) {
+	end_batch(lights.batch);
+	restore_light_state(lights);
+}
+
+void apply_light_map(LightMap& lights) {
+	lights.previous_blending = glIsEnabled(GL_BLEND);
+	lights.previous_depth = glIsEnabled(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_DST_COLOR, GL_ZERO);
+	glDisable(GL_DEPTH_TEST);
+
+	start_shader(composite_shader);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, lights.buffer.texture.ID);
+	upload_int(composite_shader, "source", 0);
+	glBindVertexArray(light_vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	stop_shader();
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	if (!lights.previous_blending)
+		glDisable(GL_BLEND);
+	if (lights.previous_depth)
+		glEnable(GL_DEPTH_TEST);
+}
+
+void dispose_light_map(LightMap& lights) {
+	dispose_framebuffer(lights.buffer);
+	dispose_batch(lights.batch);
+	lights = LightMap();
+
+	if (light_users > 0 && --light_users == 0) {
+		glDeleteVertexArrays(1, &light_vao);
+		light_vao = 0;
+		dispose_shader(light_shader);
+		dispose_shader(composite_shader);
+	}
+}
+
+#if defined(BMT_USE_NAMESPACE) 
+}
+#endif
@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                       lighting.h                                //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2018 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include <vector>
+#include "defines.h"
+#include "batch.h"
+#include "shader.h"
+#include "texture.h"
+
+#if defined(BMT_USE_NAMESPACE) 
+namespace bmt {
+#endif
+
+//the light buffer is this many times smaller than the scene on each side
+#ifndef LIGHT_BUFFER_SCALE
+#define LIGHT_BUFFER_SCALE	4
+#endif
+
+//quads per light draw call, a light casting shadows takes one per edge of its polygon
+#ifndef LIGHT_BATCH_SIZE
+#define LIGHT_BATCH_SIZE	4096
+#endif
+
+struct LightVertex {
+	vec2 pos;
+	vec2 local;		//position relative to the light in radii, 1 is where the light ends
+	vec4 color;		//0 to 1, alpha scales the intensity
+	vec4 cone;		//direction (x, y), cosine of the half angle, width of the soft edge
+};
+
+BATCH_VERTEX_LAYOUT(LightVertex,
+	VERTEX_ATTRIB(LightVertex, pos, "position", 2, GL_FLOAT, GL_FALSE),
+	VERTEX_ATTRIB(LightVertex, local, "local", 2, GL_FLOAT, GL_FALSE),
+	VERTEX_ATTRIB(LightVertex, color, "color", 4, GL_FLOAT, GL_FALSE),
+	VERTEX_ATTRIB(LightVertex, cone, "cone", 4, GL_FLOAT, GL_FALSE)
+);
+
+//================================================
+//Description: A reduced size buffer that lights 
+//	are added up in, then multiplied over the 
+//	scene in one fullscreen pass. At the default
+//	quarter size every light shades a sixteenth
+//	of the pixels it covers.
+//================================================
+struct LightMap {
+	u32 width;
+	u32 height;
+	bool follow_window;
+	u8 scale;
+	vec4 ambient;
+	Framebuffer buffer;
+	Batch<LightVertex> batch;
+	std::vector<Rect> occluders;
+	GLint previous_buffer;
+	GLint previous_viewport[4];
+	GLboolean previous_blending;
+	GLboolean previous_depth;
+};
+
+//==========================================================================================
+//Description: Creates a light map
+//
+//Parameters: 
+//		-(OPTIONAL) The size of the scene in pixels. 0 makes it the size of the window
+//			and recreates the buffer whenever the window resizes (default = 0)
+//		-(OPTIONAL) How many times smaller the light buffer is (default = LIGHT_BUFFER_SCALE)
+//==========================================================================================
+LightMap create_light_map(u32 width = 0, u32 height = 0, u8 scale = LIGHT_BUFFER_SCALE);
+//==========================================================================================
+//Description: Sets the light everything gets without any light on it, a color (RGBA)
+//	from 0 to 255 (default = black)
+//==========================================================================================
+void set_ambient_light(LightMap& lights, vec4 color);
+//==========================================================================================
+//Description: Adds a rectangle that blocks the lights drawn with shadows
+//
+//Comments: Shadows are cut out on the CPU. Every light casting them tests the occluders
+//		around it, so keep shadows to the lights that need them.
+//==========================================================================================
+void add_light_occluder(LightMap& lights, Rect area);
+void clear_light_occluders(LightMap& lights);
+//==========================================================================================
+//Description: Starts drawing lights into the light map
+//
+//Parameters: 
+//		-A light map
+//		-The projection and view matrices the scene is drawn with, so lights line up
+//			with it (for a Camera2D, pass camera_view_matrix_2D() as the view)
+//
+//Comments: Clears the buffer to the ambient light. Call it outside begin2D and end2D.
+//==========================================================================================
+void begin_lights(LightMap& lights, mat4 projection, mat4 view = identity());
+//==========================================================================================
+//Description: Adds a light that fades out from its center to its radius
+//
+//Parameters: 
+//		-A light map between begin_lights and end_lights
+//		-The center and radius of the light
+//		-A color (RGBA) from 0 to 255, alpha scales the intensity
+//		-(OPTIONAL) Whether the occluders block the light (default = false)
+//==========================================================================================
+void draw_point_light(LightMap& lights, vec2 pos, f32 radius, vec4 color, bool shadows = false);
+//==========================================================================================
+//Description: Adds a light shining in a cone
+//
+//Parameters: 
+//		-A light map between begin_lights and end_lights
+//		-The origin and reach of the light
+//		-The direction of the cone and the angle it covers, in degrees
+//		-A color (RGBA) from 0 to 255, alpha scales the intensity
+//		-(OPTIONAL) Whether the occluders block the light (default = false)
+//==========================================================================================
+void draw_cone_light(LightMap& lights, vec2 pos, f32 radius, f32 direction, f32 angle, vec4 color, bool shadows = false);
+void end_lights(LightMap& lights);
+//==========================================================================================
+//Description: Multiplies the light map over the bound framebuffer (by default the window),
+//	filtering it back up to full size
+//
+//Comments: Draw the scene first. Call it outside begin2D and end2D.
+//==========================================================================================
+void apply_light_map(LightMap& lights);
+void dispose_light_map(LightMap& lights);
+
+#if defined(BMT_USE_NAMESPACE) 
+}
+#endif
+
+#endif
@@ -0,0 +1,334 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                    postprocess.cpp                              //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2018 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#include "postprocess.h"
+#include "window.h"
+
+#if defined(BMT_USE_NAMESPACE) 
+namespace bmt {
+#endif
+
+//a single triangle covering the screen, generated from gl_VertexID so no buffers are needed
+const GLchar* POST_VERT_SHADER = R"FOO(
+#version 130
+out vec2 pass_uv;
+
+void main() {
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	pass_uv = corner;
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+
+)FOO";
+
+const GLchar* POST_COPY_FRAG_SHADER = R"FOO(
+#version 130
+out vec4 outColor;
+in vec2 pass_uv;
+uniform sampler2D source;
+
+void main() {
+	outColor = texture(source, pass_uv);
+}
+
+)FOO";
+
+const GLchar* POST_DOWNSAMPLE_FRAG_SHADER = R"FOO(
+#version 130
+out vec4 outColor;
+in vec2 pass_uv;
+uniform sampler2D source;
+uniform vec2 texel;
+
+void main() {
+	//every bilinear sample averages 4 texels
+	vec4 sum = texture(source, pass_uv + texel * vec2(-1.0, -1.0));
+	sum += texture(source, pass_uv + texel * vec2(1.0, -1.0));
+	sum += texture(source, pass_uv + texel * vec2(-1.0, 1.0));
+	sum += texture(source, pass_uv + texel * vec2(1.0, 1.0));
+	outColor = sum * 0.25;
+}
+
+)FOO";
+
+const GLchar* POST_UPSAMPLE_FRAG_SHADER = R"FOO(
+#version 130
+out vec4 outColor;
+in vec2 pass_uv;
+uniform sampler2D source;
+uniform vec2 texel;
+
+void main() {
+	vec4 sum = texture(source, pass_uv) * 4.0;
+	sum += texture(source, pass_uv + texel * vec2(-1.0, 0.0)) * 2.0;
+	sum += texture(source, pass_uv + texel * vec2(1.0, 0.0)) * 2.0;
+	sum += texture(source, pass_uv + texel * vec2(0.0, -1.0)) * 2.0;
+	sum += texture(source, pass_uv + texel * vec2(0.0, 1.0)) * 2.0;
+	sum += texture(source, pass_uv + texel * vec2(-1.0, -1.0));
+	sum += texture(source, pass_uv + texel * vec2(1.0, -1.0));
+	sum += texture(source, pass_uv + texel * vec2(-1.0, 1.0));
+	sum += texture(source, pass_uv + texel * vec2(1.0, 1.0));
+	outColor = sum / 16.0;
+}
+
+)FOO";
+
+const GLchar* POST_BLUR_FRAG_SHADER = R"FOO(
+#version 130
+out vec4 outColor;
+in vec2 pass_uv;
+uniform sampler2D source;
+uniform vec2 texel;
+uniform vec2 direction;
+
+//a 9 tap gaussian, pairs of taps merged into one bilinear sample between them
+const float offsets[3] = float[](0.0, 1.3846153846, 3.2307692308);
+const float weights[3] = float[](0.2270270270, 0.3162162162, 0.0702702703);
+
+void main() {
+	vec4 sum = texture(source, pass_uv) * weights[0];
+	for (int i = 1; i < 3; ++i) {
+		vec2 offset = direction * texel * offsets[i];
+		sum += texture(source, pass_uv + offset) * weights[i];
+		sum += texture(source, pass_uv - offset) * weights[i];
+	}
+	outColor = sum;
+}
+
+)FOO";
+
+//the built in shaders and the empty vertex array are shared by every pipeline
+INTERNAL u32 post_users;
+INTERNAL GLuint post_vao;
+INTERNAL Shader copy_shader;
+INTERNAL Shader downsample_shader;
+INTERNAL Shader upsample_shader;
+INTERNAL Shader blur_shader;
+
+INTERNAL inline
+u32 scale_level(u8 scale) {
+	if (scale >= POST_SCALE_QUARTER)
+		return 2;
+	if (scale >= POST_SCALE_HALF)
+		return 1;
+	return 0;
+}
+
+//==========================================================================================
+//Description: Creates a color target that filters linearly and clamps to its edge, so 
+//	passes can sample between and past texels.
+//==========================================================================================
+INTERNAL
+Framebuffer create_post_target(u32 width, u32 height) {
+	Framebuffer target = create_framebuffer(width > 0 ? width : 1, height > 0 ? height : 1, GL_LINEAR, COLORBUFFER);
+	glBindTexture(GL_TEXTURE_2D, target.texture.ID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return target;
+}
+
+INTERNAL
+void create_post_level(PostProcess& post, u32 level) {
+	u32 divisor = 1 << level;
+	for (u32 i = 0; i < 2; ++i)
+		post.targets[level][i] = create_post_target(post.width / divisor, post.height / divisor);
+}
+
+INTERNAL
+void resize_post_process(PostProcess& post, u32 width, u32 height) {
+	post.width = width;
+	post.height = height;
+	dispose_framebuffer(post.scene);
+	post.scene = create_post_target(width, height);
+	for (u32 level = 0; level < POST_SCALE_LEVELS; ++level) {
+		if (post.targets[level][0].ID == 0)
+			continue;
+		for (u32 i = 0; i < 2; ++i)
+			dispose_framebuffer(post.targets[level][i]);
+		create_post_level(post, level);
+	}
+}
+
+PostProcess create_post_process(u32 width, u32 height) {
+	PostProcess post = { 0 };
+	post.follow_window = width == 0 || height == 0;
+	post.width = post.follow_window ? get_window_width() : width;
+	post.height = post.follow_window ? get_window_height() : height;
+	post.scene = create_post_target(post.width, post.height);
+
+	if (post_users++ == 0) {
+		glGenVertexArrays(1, &post_vao);
+		copy_shader = load_post_shader(POST_COPY_FRAG_SHADER);
+		downsample_shader = load_post_shader(POST_DOWNSAMPLE_FRAG_SHADER);
+		upsample_shader = load_post_shader(POST_UPSAMPLE_FRAG_SHADER);
+		blur_shader = load_post_shader(POST_BLUR_FRAG_SHADER);
+	}
+	return post;
+}
+
+INTERNAL
+void add_post_pass(PostProcess& post, Shader shader, u8 scale, vec2 direction) {
+	if (post.passcount >= POST_MAX_PASSES) {
+		BMT_LOG(WARNING, "Post-processing pipeline already has %d passes", POST_MAX_PASSES);
+		return;
+	}
+	u32 level = scale_level(scale);
+	if (post.targets[level][0].ID == 0)
+		create_post_level(post, level);
+
+	PostPass& pass = post.passes[post.passcount++];
+	pass.shader = shader;
+	pass.scale = 1 << level;
+	pass.direction = direction;
+}
+
+void add_post_pass(PostProcess& post, Shader shader, u8 scale) {
+	add_post_pass(post, shader, scale, V2(0, 0));
+}
+
+void add_downsample_pass(PostProcess& post, u8 scale) {
+	add_post_pass(post, downsample_shader, scale, V2(0, 0));
+}
+
+void add_upsample_pass(PostProcess& post, u8 scale) {
+	add_post_pass(post, upsample_shader, scale, V2(0, 0));
+}
+
+void add_blur_passes(PostProcess& post, u8 scale) {
+	add_post_pass(post, blur_shader, scale, V2(1, 0));
+	add_post_pass(post, blur_shader, scale, V2(0, 1));
+}
+
+void begin_post_process(PostProcess& post) {
+	if (post.follow_window) {
+		i32 width = get_window_width();
+		i32 height = get_window_height();
+		//a minimized window reports 0, keep the old targets until it comes back
+		if (width > 0 && height > 0 && ((u32)width != post.width || (u32)height != post.height))
+			resize_post_process(post, width, height);
+	}
+
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &post.previous_buffer);
+	glGetIntegerv(GL_VIEWPORT, post.previous_viewport);
+	bind_framebuffer(post.scene);
+	glViewport(0, 0, post.width, post.height);
+	glClear(GL_COLOR_BUFFER_BIT);
+}
+
+//==========================================================================================
+//Description: Draws one fullscreen triangle with a pass shader, reading input
+//==========================================================================================
+INTERNAL
+void run_post_pass(PostProcess& post, Shader shader, const Texture& input, vec2 direction) {
+	start_shader(shader);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, input.ID);
+	upload_int(shader, "source", 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, post.scene.texture.ID);
+	upload_int(shader, "scene", 1);
+	upload_vec2(shader, "texel", V2(1.0f / input.width, 1.0f / input.height));
+	upload_vec2(shader, "direction", direction);
+
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void end_post_process(PostProcess& post) {
+	GLboolean blending = glIsEnabled(GL_BLEND);
+	GLboolean depth = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	glBindVertexArray(post_vao);
+
+	const Framebuffer* input = &post.scene;
+	bool presented = false;
+	for (u32 i = 0; i < post.passcount; ++i) {
+		PostPass& pass = post.passes[i];
+		//a last pass at full size renders straight into the output, saving a copy
+		if (i == post.passcount - 1 && pass.scale == POST_SCALE_FULL) {
+			glBindFramebuffer(GL_FRAMEBUFFER, post.previous_buffer);
+			glViewport(post.previous_viewport[0], post.previous_viewport[1], post.previous_viewport[2], post.previous_viewport[3]);
+			run_post_pass(post, pass.shader, input->texture, pass.direction);
+			presented = true;
+			break;
+		}
+
+		Framebuffer* pair = post.targets[scale_level(pass.scale)];
+		Framebuffer* output = (input == &pair[0]) ? &pair[1] : &pair[0];
+		bind_framebuffer(*output);
+		glViewport(0, 0, output->texture.width, output->texture.height);
+		run_post_pass(post, pass.shader, input->texture, pass.direction);
+		input = output;
+	}
+
+	if (!presented) {
+		glBindFramebuffer(GL_FRAMEBUFFER, post.previous_buffer);
+		glViewport(post.previous_viewport[0], post.previous_viewport[1], post.previous_viewport[2], post.previous_viewport[3]);
+		run_post_pass(post, copy_shader, input->texture, V2(0, 0));
+	}
+
+	glBindVertexArray(0);
+	stop_shader();
+	if (blending)
+		glEnable(GL_BLEND);
+	if (depth)
+		glEnable(GL_DEPTH_TEST);
+}
+
+Shader load_post_shader(const GLchar* fragmentstring) {
+	return load_shader_2D_from_strings(POST_VERT_SHADER, fragmentstring);
+}
+
+void dispose_post_process(PostProcess& post) {
+	dispose_framebuffer(post.scene);
+	for (u32 level = 0; level < POST_SCALE_LEVELS; ++level) {
+		if (post.targets[level][0].ID == 0)
+			continue;
+		for (u32 i = 0; i < 2; ++i)
+			dispose_framebuffer(post.targets[level][i]);
+	}
+	post = PostProcess();
+
+	if (post_users > 0 && --post_users == 0) {
+		glDeleteVertexArrays(1, &post_vao);
+		post_vao = 0;
+		dispose_shader(copy_shader);
+		dispose_shader(downsample_shader);
+		dispose_shader(upsample_shader);
+		dispose_shader(blur_shader);
+	}
+}
+
+#if defined(BMT_USE_NAMESPACE) 
+}
+#endif
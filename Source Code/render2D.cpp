@@ -28,21 +28,170 @@
 
 #include "render2D.h"
 #include "window.h"
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+#if defined(BMT_SSE2)
+#include <emmintrin.h>
+#endif
 
 #if defined(BMT_USE_NAMESPACE) 
 namespace bmt {
 #endif
 
 INTERNAL GLuint vao;
-INTERNAL GLuint vbo;
+INTERNAL GLuint instance_vao;
 INTERNAL GLuint ebo;
-INTERNAL u16 indexcount;
+INTERNAL u32 indexcount;
+//batches holding a sprite mesh draw with indices streamed from batch_indices through 
+//mesh_ebo, every other batch uses the static quad indices in ebo
+INTERNAL GLuint mesh_ebo;
+INTERNAL std::vector<GLuint> batch_indices;
+INTERNAL bool batch_meshes;
 INTERNAL u16 texcount;
 INTERNAL GLuint  textures[BATCH_MAX_TEXTURES];
-INTERNAL GLchar* locations[BATCH_MAX_TEXTURES];
 INTERNAL VertexData* buffer;
+INTERNAL VertexData* batch_start;
+INTERNAL VertexData* batch_end;
+INTERNAL InstanceData* instances;
+INTERNAL InstanceData* instances_end;
+INTERNAL bool batch_instanced;
+INTERNAL bool batch_arrayed;
+INTERNAL GLuint bound_array;
+INTERNAL bool instancing_supported;
 INTERNAL Shader shader;
 
+//sprites per batch and the derived sizes, fixed by init2D()
+INTERNAL u32 batch_capacity;
+INTERNAL GLenum batch_index_type;
+
+//the vertex buffer every batch streams through
+INTERNAL StreamRing ring;
+
+//A draw call recorded in sorted mode, replayed through push_sprite() by end2D().
+struct SpriteCommand {
+	Texture tex;
+	bool textured;
+	f32 x, y, width, height;
+	vec4 uvs;
+	vec4 color;
+	vec2 origin;
+	f32 rotation;
+	f32 shape;
+	u8 depth;
+	u8 blend;
+	const SpriteMesh* mesh;
+	bool clipped;
+	Rect clip;
+	//vertices the recording thread built with stage_sprite(), unless the batch is instanced
+	bool staged;
+	bool polygon;
+	u16 vertexcount;
+	u32 first;				//into the recording thread's CommandList::vertices
+	VertexData* vertices;	//set by merge_command_lists()
+};
+
+//sort keys are laid out high to low as translucency (1 bit), layer (8 bits), texture (23 
+//bits) and the index of the command (32 bits), so sorting the keys alone also keeps 
+//same-texture draws in order. Opaque commands come first and store 255 - layer, putting 
+//them front to back.
+#define SORT_KEY_TRANSLUCENT	(1ULL << 63)
+#define SORT_KEY_LAYER_SHIFT	55
+#define SORT_KEY_TEXTURE_SHIFT	32
+#define SORT_KEY_TEXTURE_MASK	0x7FFFFF
+#define SORT_KEY_INDEX_MASK		0xFFFFFFFF
+
+//sprites entirely outside cull_rect are dropped before anything is written
+INTERNAL bool culling;
+INTERNAL Rect cull_rect;
+//the area init2D() was given, which a camera maps the world onto
+INTERNAL Rect view_area;
+//set_camera_2D() or reset_camera_2D() was called, so begin2D() uploads view_matrix
+INTERNAL bool camera_set;
+INTERNAL mat4 view_matrix;
+INTERNAL Rect camera_cull;
+
+INTERNAL Render2DStats frame_stats;
+INTERNAL Render2DStats last_frame_stats;
+
+//SDF shapes are untextured quads with their kind in the blend flags above 
+//BLEND_SHAPE_SHIFT and a texid of parameter * 0.99, which the shaders decode into the 
+//shape to evaluate. Keeping the kind out of the texid leaves every texid to textures.
+#define BLEND_SHAPE_SHIFT	2
+#define SHAPE_ELLIPSE		1
+#define SHAPE_RING			2
+#define SHAPE_ROUNDED_RECT	3
+
+//blend flags written into every vertex, on top of the blend mode
+#define BLEND_PREMULTIPLIED_TEXTURE	2
+
+//why a batch was flushed, counted separately in Render2DStats
+#define FLUSH_EXPLICIT	0
+#define FLUSH_TEXTURES	1
+#define FLUSH_CAPACITY	2
+
+//timing is opt in since it reads the clock around every draw call
+INTERNAL bool stats_timing;
+INTERNAL bool timer_queries_supported;
+INTERNAL u32 emit_depth;
+INTERNAL f64 flush_seconds;
+INTERNAL std::vector<GLuint> frame_textures;
+INTERNAL Render2DStats stats_history[RENDER_STATS_HISTORY];
+INTERNAL u64 stats_frame;
+
+//GL_TIME_ELAPSED queries, one set per frame in flight. A set is read back when its slot
+//comes around again RENDER_STATS_QUERY_FRAMES frames later, so reading never stalls.
+#define RENDER_STATS_QUERY_FRAMES	4
+#define RENDER_STATS_QUERIES		64
+INTERNAL GLuint stats_queries[RENDER_STATS_QUERY_FRAMES][RENDER_STATS_QUERIES];
+INTERNAL u32 stats_query_count[RENDER_STATS_QUERY_FRAMES];
+INTERNAL bool stats_query_active;
+
+//Every thread records sorted-mode draw calls into its own list, so workers never touch
+//shared state while recording. The lists are merged by stream on the GL thread.
+struct CommandList {
+	std::vector<SpriteCommand> commands;
+	std::vector<u64> keys;
+	std::vector<VertexData> vertices;
+	u32 stream;
+	u8 layer;
+	bool opaque;
+	u8 blend;
+	std::vector<Rect> clips;
+	u32 emitted;
+	u32 culled;
+	u64 owner;	//ticket of the thread recording into the list, 0 while it is in the pool
+	bool used;	//its thread called into the renderer since the last begin2D
+};
+
+INTERNAL bool batch_sorted;
+//sorted with depth testing, so end2D() splits the commands into an opaque and a blended pass
+INTERNAL bool batch_depth;
+//the depth func before the depth pass changed it, put back by end2D()
+INTERNAL GLint saved_depth_func;
+INTERNAL bool batch_blending;
+//the shader reads the blend attribute and writes premultiplied colors
+INTERNAL bool batch_premultiplied;
+//between begin2D and end2D
+INTERNAL bool batch_open;
+INTERNAL std::thread::id gl_thread;
+INTERNAL std::mutex command_lists_lock;
+INTERNAL std::vector<CommandList*> command_lists;
+//lists of threads that stopped recording, handed to the next thread that needs one
+INTERNAL std::vector<CommandList*> free_command_lists;
+INTERNAL u32 command_generation = 1;
+INTERNAL u64 command_tickets = 0;
+INTERNAL thread_local CommandList* local_commands = NULL;
+INTERNAL thread_local u32 local_generation = 0;
+INTERNAL thread_local u64 local_ticket = 0;
+
+//the merged commands and keys of all threads
+INTERNAL std::vector<SpriteCommand> commands;
+INTERNAL std::vector<u64> sort_keys;
+INTERNAL std::vector<u64> sort_scratch;
+
 const GLchar* ORTHO_SHADER_FRAG_SHADER = R"FOO(
 #version 130
 out vec4 outColor;
@@ -50,6 +199,44 @@ out vec4 outColor;
 in vec4 pass_color;
 in vec2 pass_uv;
 in float pass_texid;
+in vec2 pass_shape;
+in vec2 pass_blend;
+
+//SDF shapes (a kind in the blend flags) carry their kind and parameter in pass_shape, and
+//their position inside the quad in pass_uv. The quad has a pixel of margin on every side.
+float shape_coverage(float kind, float param) {
+	vec2 p = pass_uv * 2.0 - 1.0;
+	vec2 px = vec2(length(vec2(dFdx(p.x), dFdy(p.x))), length(vec2(dFdx(p.y), dFdy(p.y))));
+	vec2 quadsize = 1.0 / max(px, vec2(0.000001));
+	vec2 halfsize = max(quadsize - 1.0, vec2(0.001));
+	vec2 q = p * quadsize;
+	float r = min(halfsize.x, halfsize.y);
+
+	float d;
+	if (kind < 1.5) {
+		d = (length(q / halfsize) - 1.0) * r;
+	}
+	else if (kind < 2.5) {
+		float thickness = param * r;
+		d = abs((length(q / halfsize) - 1.0) * r + thickness * 0.5) - thickness * 0.5;
+	}
+	else {
+		float radius = param * r;
+		vec2 e = abs(q) - halfsize + radius;
+		d = length(max(e, 0.0)) + min(max(e.x, e.y), 0.0) - radius;
+	}
+	//d is in pixels, so a one pixel ramp around the edge antialiases it
+	return mix(1.0, clamp(0.5 - d, 0.0, 1.0), step(0.5, kind));
+}
+
+//the output is premultiplied for GL_ONE, GL_ONE_MINUS_SRC_ALPHA. Premultiplied textures 
+//already carry their alpha in the color, and additive sprites write an alpha of 0 so 
+//nothing behind them is darkened.
+vec4 premultiply(vec4 color, float coverage) {
+	color.rgb *= mix(color.a, pass_color.a, pass_blend.y) * coverage;
+	color.a *= coverage * (1.0 - pass_blend.x);
+	return color;
+}
 
 uniform sampler2D tex1;
 uniform sampler2D tex2;
@@ -87,17 +274,73 @@ void main() {
 		if(pass_texid == 15.0) texColor = texture(tex15, pass_uv);
 		if(pass_texid == 16.0) texColor = texture(tex16, pass_uv);
 	}
-	outColor = pass_color * texColor;
+	outColor = premultiply(pass_color * texColor, shape_coverage(pass_shape.x, pass_shape.y));
+}
+
+)FOO";
+
+const GLchar* ARRAY_SHADER_FRAG_SHADER = R"FOO(
+#version 130
+out vec4 outColor;
+
+in vec4 pass_color;
+in vec2 pass_uv;
+in float pass_texid;
+in vec2 pass_shape;
+in vec2 pass_blend;
+
+//SDF shapes (a kind in the blend flags) carry their kind and parameter in pass_shape, and
+//their position inside the quad in pass_uv. The quad has a pixel of margin on every side.
+float shape_coverage(float kind, float param) {
+	vec2 p = pass_uv * 2.0 - 1.0;
+	vec2 px = vec2(length(vec2(dFdx(p.x), dFdy(p.x))), length(vec2(dFdx(p.y), dFdy(p.y))));
+	vec2 quadsize = 1.0 / max(px, vec2(0.000001));
+	vec2 halfsize = max(quadsize - 1.0, vec2(0.001));
+	vec2 q = p * quadsize;
+	float r = min(halfsize.x, halfsize.y);
+
+	float d;
+	if (kind < 1.5) {
+		d = (length(q / halfsize) - 1.0) * r;
+	}
+	else if (kind < 2.5) {
+		float thickness = param * r;
+		d = abs((length(q / halfsize) - 1.0) * r + thickness * 0.5) - thickness * 0.5;
+	}
+	else {
+		float radius = param * r;
+		vec2 e = abs(q) - halfsize + radius;
+		d = length(max(e, 0.0)) + min(max(e.x, e.y), 0.0) - radius;
+	}
+	//d is in pixels, so a one pixel ramp around the edge antialiases it
+	return mix(1.0, clamp(0.5 - d, 0.0, 1.0), step(0.5, kind));
+}
+
+//the output is premultiplied for GL_ONE, GL_ONE_MINUS_SRC_ALPHA. Premultiplied textures 
+//already carry their alpha in the color, and additive sprites write an alpha of 0 so 
+//nothing behind them is darkened.
+vec4 premultiply(vec4 color, float coverage) {
+	color.rgb *= mix(color.a, pass_color.a, pass_blend.y) * coverage;
+	color.a *= coverage * (1.0 - pass_blend.x);
+	return color;
+}
+
+uniform sampler2DArray layers;
+void main() {
+	//texid 0 is an untextured quad, anything else is the layer + 1
+	vec4 texColor = texture(layers, vec3(pass_uv, max(pass_texid - 1.0, 0.0)));
+	outColor = premultiply(pass_color * mix(vec4(1.0), texColor, step(0.5, pass_texid)), shape_coverage(pass_shape.x, pass_shape.y));
 }
 
 )FOO";
 
 const GLchar* ORTHO_SHADER_VERT_SHADER = R"FOO(
 #version 130
-in vec2 position;
+in vec3 position;
 in vec4 color;
 in vec2 uv;
-in float texid;
+in vec3 texid;
+in float blend;
 
 uniform mat4 projection = mat4(1.0);
 uniform mat4 view = mat4(1.0);
@@ -105,261 +348,1383 @@ uniform mat4 view = mat4(1.0);
 out vec4 pass_color;
 out vec2 pass_uv;
 out float pass_texid;
+out vec2 pass_shape;
+out vec2 pass_blend;
 
 void main() {
 	pass_color = color;
+	//bit 0 is additive, bit 1 a texture with premultiplied alpha, the bits above the kind of
+	//an SDF shape
+	pass_blend = vec2(mod(blend, 2.0), step(2.0, mod(blend, 4.0)));
 	pass_uv = uv;
-	pass_texid = texid;
+	//a shape has its parameter in the fraction of texid (or in the second component for 
+	//compact vertices)
+	float kind = floor(blend / 4.0);
+	float shape = step(0.5, kind);
+	pass_texid = texid.x * (1.0 - shape);
+	pass_shape = vec2(kind, shape * max(texid.y / 255.0, fract(texid.x) / 0.99));
+	
+	gl_Position = projection * view * vec4(position.xy, 1.0, 1.0);
+	//the layer is in position.z, or in texid.z for compact vertices. Higher layers are closer.
+	gl_Position.z = (0.99 - 1.98 * (position.z + texid.z) / 255.0) * gl_Position.w;
+}
+
+)FOO";
+
+const GLchar* INSTANCED_SHADER_VERT_SHADER = R"FOO(
+#version 130
+in vec4 instance_rect;
+in vec4 instance_transform;
+in vec4 instance_uvs;
+in vec4 instance_color;
+in float instance_depth;
+in float instance_blend;
+
+uniform mat4 projection = mat4(1.0);
+uniform mat4 view = mat4(1.0);
+
+out vec4 pass_color;
+out vec2 pass_uv;
+out float pass_texid;
+out vec2 pass_shape;
+out vec2 pass_blend;
+
+void main() {
+	//triangle strip order: top left, bottom left, top right, bottom right
+	vec2 corner = vec2(float(gl_VertexID / 2), float(gl_VertexID % 2));
+	vec2 local = corner * instance_rect.zw - instance_transform.xy;
+
+	float c = cos(instance_transform.z);
+	float s = sin(instance_transform.z);
+	vec2 position = vec2(c * local.x - s * local.y, s * local.x + c * local.y);
+	position += instance_rect.xy + instance_transform.xy;
+
+	pass_color = instance_color;
+	pass_blend = vec2(mod(instance_blend, 2.0), step(2.0, mod(instance_blend, 4.0)));
+	pass_uv = mix(instance_uvs.xy, instance_uvs.zw, corner);
+	//the blend bits above the first two are the kind of an SDF shape, with the parameter 
+	//in the fraction of texid
+	float kind = floor(instance_blend / 4.0);
+	float shape = step(0.5, kind);
+	pass_texid = instance_transform.w * (1.0 - shape);
+	pass_shape = vec2(kind, shape * fract(instance_transform.w) / 0.99);
 	
 	gl_Position = projection * view * vec4(position, 1.0, 1.0);
+	gl_Position.z = (0.99 - 1.98 * instance_depth / 255.0) * gl_Position.w;
 }
 
 )FOO";
 
 INTERNAL
-GLfloat DEFAULT_UVS[8] = {
-	0, 0, 0, 1,
-	1, 1, 1, 0
-};
+void set_vertex_attribs(GLintptr base) {
+	u32 count;
+	const VertexAttrib* attribs = VertexLayout<VertexData>::attribs(&count);
+	set_layout_attribs(attribs, count, BATCH_VERTEX_SIZE, base, NULL);
+}
+
 INTERNAL
-GLfloat FLIP_HORIZONTAL_UVS[8] = {
-	1, 0, 1, 1,
-	0, 1, 0, 0
-};
+void set_instance_attribs(GLintptr base) {
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const GLvoid*)(base + offsetof(InstanceData, rect)));      //rect
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const GLvoid*)(base + offsetof(InstanceData, transform))); //origin, rotation, texture id
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const GLvoid*)(base + offsetof(InstanceData, uvs)));       //tex coords
+	glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(InstanceData), (const GLvoid*)(base + offsetof(InstanceData, color))); //color
+	glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const GLvoid*)(base + offsetof(InstanceData, depth)));     //depth
+	glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const GLvoid*)(base + offsetof(InstanceData, blend)));     //blend mode
+}
+
+//==========================================================================================
+//Description: Writes a single vertex in whichever layout VertexData was compiled with
+//
+//Parameters: 
+//		-The vertex to write
+//		-A position, a color (RGBA, 0 to 1), texture coordinates, a texture slot, a layer 
+//			and blend flags
+//==========================================================================================
+INTERNAL inline
+void write_vertex(VertexData* vertex, vec2 pos, vec4 color, f32 u, f32 v, f32 texid, u8 depth, u8 blend) {
+#if defined(BATCH_COMPACT_VERTICES)
+#if defined(BATCH_COMPACT_POSITIONS)
+	f32 x = floor(pos.x + 0.5f);
+	f32 y = floor(pos.y + 0.5f);
+	clamp(x, -32768.0f, 32767.0f);
+	clamp(y, -32768.0f, 32767.0f);
+	vertex->pos[0] = (i16)x;
+	vertex->pos[1] = (i16)y;
+#else
+	vertex->pos = pos;
+#endif
+	clamp(color.x, 0.0f, 1.0f);
+	clamp(color.y, 0.0f, 1.0f);
+	clamp(color.z, 0.0f, 1.0f);
+	clamp(color.w, 0.0f, 1.0f);
+	clamp(u, 0.0f, 1.0f);
+	clamp(v, 0.0f, 1.0f);
+	vertex->color = rgba_to_u32(
+		(i32)(color.x * 255.0f + 0.5f), (i32)(color.y * 255.0f + 0.5f),
+		(i32)(color.z * 255.0f + 0.5f), (i32)(color.w * 255.0f + 0.5f)
+	);
+	vertex->uv[0] = (u16)(u * 65535.0f + 0.5f);
+	vertex->uv[1] = (u16)(v * 65535.0f + 0.5f);
+	vertex->texid = (u8)texid;
+	vertex->shape_param = (blend >> BLEND_SHAPE_SHIFT) ? (u8)((texid - floor(texid)) / 0.99f * 255.0f + 0.5f) : 0;
+	vertex->depth = depth;
+	vertex->blend = blend;
+#else
+	vertex->pos = pos;
+	vertex->depth = depth;
+	vertex->blend = blend;
+	vertex->color = color;
+	vertex->uv.x = u;
+	vertex->uv.y = v;
+	vertex->texid = texid;
+#endif
+}
+
+//==========================================================================================
+//Description: Points buffer at the next free batch-sized range of the ring. end_frame_2D()
+//	fences the ring once per frame.
+//==========================================================================================
 INTERNAL
-GLfloat FLIP_VERTICAL_UVS[8] = {
-	0, 1, 0, 0,
-	1, 0, 1, 1
-};
+void begin_batch() {
+	buffer = (VertexData*)map_stream_ring(ring);
+	batch_start = buffer;
+	batch_end = batch_start + batch_capacity * 4;
+	//instance records share the ring, InstanceData is never larger than a sprite's vertices
+	static_assert(sizeof(InstanceData) <= BATCH_SPRITE_SIZE, "InstanceData must fit in one sprite");
+	instances = (InstanceData*)batch_start;
+	instances_end = instances + batch_capacity;
+}
+
+INTERNAL inline
+void begin_gpu_timer() {
+	u32 slot = stats_frame % RENDER_STATS_QUERY_FRAMES;
+	if (!stats_timing || !timer_queries_supported || stats_query_count[slot] >= RENDER_STATS_QUERIES)
+		return;
+	glBeginQuery(GL_TIME_ELAPSED, stats_queries[slot][stats_query_count[slot]++]);
+	stats_query_active = true;
+}
+
+INTERNAL inline
+void end_gpu_timer() {
+	if (!stats_query_active)
+		return;
+	glEndQuery(GL_TIME_ELAPSED);
+	stats_query_active = false;
+}
+
+//==========================================================================================
+//Description: Starts and stops timing vertex emission. Calls nest, only the outermost pair
+//	measures, and time spent in flushes in between is left out.
+//==========================================================================================
+INTERNAL inline
+f64 begin_emit_timer() {
+	if (!stats_timing)
+		return -1;
+	if (emit_depth++ > 0)
+		return 0;
+	flush_seconds = 0;
+	return glfwGetTime();
+}
+
+INTERNAL inline
+void end_emit_timer(f64 start) {
+	if (start < 0 || --emit_depth > 0)
+		return;
+	frame_stats.emit_ms += (f32)((glfwGetTime() - start - flush_seconds) * 1000.0);
+}
+
 INTERNAL
-GLfloat FLIP_BOTH_UVS[8] = {
-	1, 1, 1, 0,
-	0, 0, 0, 1
-};
+void count_texture(GLuint ID) {
+	std::vector<GLuint>::iterator it = std::lower_bound(frame_textures.begin(), frame_textures.end(), ID);
+	if (it != frame_textures.end() && *it == ID)
+		return;
+	frame_textures.insert(it, ID);
+	frame_stats.textures++;
+}
+
+//==========================================================================================
+//Description: Draws everything written since begin_batch() and advances the ring past it.
+//	Shader and blend state are left untouched so a mid-batch flush is invisible to the caller.
+//==========================================================================================
+INTERNAL
+void flush_batch(u8 reason) {
+	f64 start = (emit_depth > 0) ? glfwGetTime() : 0;
+	GLsizeiptr used = (u8*)buffer - (u8*)batch_start;
+	if (batch_instanced)
+		used = (u8*)instances - (u8*)batch_start;
+
+	unmap_stream_ring(ring);
+
+	if (indexcount > 0) {
+		if (batch_arrayed) {
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, bound_array);
+			upload_int(shader, "layers", 0);
+		}
+		bind_batch_textures(shader, textures, texcount);
+
+		if (batch_instanced) {
+			glBindVertexArray(instance_vao);
+			set_instance_attribs(ring.head);
+		}
+		else {
+			glBindVertexArray(vao);
+			set_vertex_attribs(ring.head);
+		}
+		glEnableVertexAttribArray(0); //position
+		glEnableVertexAttribArray(1); //color
+		glEnableVertexAttribArray(2); //texture coordinates
+		glEnableVertexAttribArray(3); //texture ID
+		glEnableVertexAttribArray(4); //blend mode (depth when instanced)
+		if (batch_instanced)
+			glEnableVertexAttribArray(5); //blend mode
+
+		if (batch_meshes) {
+			//the element buffer binding belongs to the vao, so the static one is put back after
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_ebo);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexcount * sizeof(GLuint), &batch_indices[0], GL_STREAM_DRAW);
+		}
+
+		begin_gpu_timer();
+		if (batch_instanced)
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, indexcount / 6);
+		else if (batch_meshes)
+			glDrawElements(GL_TRIANGLES, indexcount, GL_UNSIGNED_INT, 0);
+		else
+			glDrawElements(GL_TRIANGLES, indexcount, batch_index_type, 0);
+		end_gpu_timer();
+
+		if (batch_meshes) {
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+			frame_stats.bytes_uploaded += indexcount * sizeof(GLuint);
+		}
+
+		glDisableVertexAttribArray(0); //position
+		glDisableVertexAttribArray(1); //color
+		glDisableVertexAttribArray(2); //texture coordinates
+		glDisableVertexAttribArray(3); //textureID
+		glDisableVertexAttribArray(4); //blend mode (depth when instanced)
+		glDisableVertexAttribArray(5); //blend mode
+		glBindVertexArray(0);
+
+		frame_stats.drawcalls++;
+		frame_stats.quads += indexcount / 6;
+		frame_stats.bytes_uploaded += used;
+		if (reason == FLUSH_TEXTURES)
+			frame_stats.flushes_textures++;
+		else if (reason == FLUSH_CAPACITY)
+			frame_stats.flushes_capacity++;
+		else
+			frame_stats.flushes_explicit++;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	advance_stream_ring(ring, used);
+	indexcount = 0;
+	batch_meshes = false;
+	texcount = 0;
+	if (start != 0)
+		flush_seconds += glfwGetTime() - start;
+	bound_array = 0;
+}
 
 INTERNAL
 int submit_tex(Texture tex) {
-	int texSlot = 0;
-	bool found = false;
-	for (u32 i = 0; i < texcount; ++i) {
-		if (textures[i] == tex.ID) {
-			texSlot = (i + 1);
-			found = true;
-			break;
+	//the array shader samples one texture array, so only a change of array forces a flush
+	if (batch_arrayed) {
+		if (tex.target != GL_TEXTURE_2D_ARRAY)
+			return 0;
+		if (bound_array != tex.ID) {
+			if (bound_array != 0) {
+				flush_batch(FLUSH_TEXTURES);
+				begin_batch();
+			}
+			bound_array = tex.ID;
+			count_texture(tex.ID);
 		}
+#if defined(BATCH_COMPACT_VERTICES)
+		//compact vertices hold the texid in a byte
+		if (tex.layer >= 255)
+			return 0;
+#endif
+		return tex.layer + 1;
 	}
-	if (!found) {
+
+	int texSlot = find_texture_slot(textures, texcount, tex.ID);
+	if (texSlot == 0) {
 		if (texcount >= BATCH_MAX_TEXTURES) {
-			end2D();
-			begin2D(shader);
+			flush_batch(FLUSH_TEXTURES);
+			begin_batch();
 		}
 		textures[texcount++] = tex.ID;
 		texSlot = texcount;
+		count_texture(tex.ID);
+	}
+	return texSlot;
+}
+
+//==========================================================================================
+//Description: Returns the (left, top, right, bottom) texture coordinates of a texture
+//	region with the texture's flip_flag applied.
+//==========================================================================================
+INTERNAL inline
+vec4 flip_uvs(u64 flip_flag, f32 left, f32 top, f32 right, f32 bottom) {
+	if (flip_flag & FLIP_HORIZONTAL) {
+		f32 temp = left;
+		left = right;
+		right = temp;
+	}
+	if (flip_flag & FLIP_VERTICAL) {
+		f32 temp = top;
+		top = bottom;
+		bottom = temp;
+	}
+	return V4(left, top, right, bottom);
+}
+
+//==========================================================================================
+//Description: Returns the texture coordinates of an area of a texture (given from 0 to 1),
+//	moved into the texture's atlas region and with its flip_flag applied.
+//==========================================================================================
+INTERNAL inline
+vec4 texture_uvs(const Texture& tex, f32 left, f32 top, f32 right, f32 bottom) {
+	if (tex.region.width != 0) {
+		left = tex.region.x + left * tex.region.width;
+		right = tex.region.x + right * tex.region.width;
+		top = tex.region.y + top * tex.region.height;
+		bottom = tex.region.y + bottom * tex.region.height;
+	}
+	return flip_uvs(tex.flip_flag, left, top, right, bottom);
+}
+
+//==========================================================================================
+//Description: Writes the four vertices of a (possibly rotated) sprite.
+//==========================================================================================
+INTERNAL inline
+void write_quad(VertexData* vertices, f32 x, f32 y, f32 width, f32 height, vec4 uvs, vec4 color, vec2 origin, f32 rotation, f32 texSlot, u8 depth, u8 blend) {
+	vec2 corners[4] = { V2(x, y), V2(x, y + height), V2(x + width, y + height), V2(x + width, y) };
+	f32 us[4] = { uvs.x, uvs.x, uvs.z, uvs.z };
+	f32 vs[4] = { uvs.y, uvs.w, uvs.w, uvs.y };
+
+	//sin and cos are expensive don't do it if there is no rotation
+	if (rotation != 0) {
+		f32 rad = deg_to_rad(rotation);
+		f32 cosine = cos(rad);
+		f32 sine = sin(rad);
+		for (u32 i = 0; i < 4; ++i) {
+			f32 dx = corners[i].x - origin.x;
+			f32 dy = corners[i].y - origin.y;
+			corners[i].x = cosine * dx - sine * dy + origin.x;
+			corners[i].y = sine * dx + cosine * dy + origin.y;
+		}
+	}
+
+	for (u32 i = 0; i < 4; ++i)
+		write_vertex(vertices + i, corners[i], color, us[i], vs[i], texSlot, depth, blend);
+}
+
+//==========================================================================================
+//Description: Returns whether the batch can take a sprite of this many vertices and indices
+//==========================================================================================
+INTERNAL inline
+bool batch_has_room(u32 vertexcount, u32 indices) {
+	return buffer + vertexcount <= batch_end && indexcount + indices <= batch_capacity * 6;
+}
+
+//==========================================================================================
+//Description: Counts the indices of the quad about to be written at buffer, and writes 
+//	them out when the batch streams its indices.
+//==========================================================================================
+INTERNAL inline
+void add_quad_indices() {
+	if (batch_meshes) {
+		GLuint base = (GLuint)(buffer - batch_start);
+		GLuint* index = &batch_indices[indexcount];
+		index[0] = base;
+		index[1] = base + 1;
+		index[2] = base + 2;
+		index[3] = base + 2;
+		index[4] = base + 3;
+		index[5] = base;
+	}
+	indexcount += 6;
+}
+
+//most points a sprite polygon can have, a mesh cut by the four sides of a clip rect
+#define SPRITE_POLYGON_MAX_POINTS	(SPRITE_MESH_MAX_POINTS + 4)
+
+//==========================================================================================
+//Description: Moves the kind of an SDF shape (kind + parameter * 0.99) into the blend 
+//	flags and returns the texid to write, the parameter part
+//==========================================================================================
+INTERNAL inline
+f32 split_shape(f32 shape, u8* blend) {
+	u32 kind = (u32)shape;
+	*blend |= (u8)(kind << BLEND_SHAPE_SHIFT);
+	return shape - kind;
+}
+
+//==========================================================================================
+//Description: Writes the triangle fan of the polygon about to be written at buffer, 
+//	switching the batch to streamed indices if it still used the static quad ones.
+//==========================================================================================
+INTERNAL
+void add_polygon_indices(u32 count) {
+	if (!batch_meshes) {
+		for (u32 i = 0; i < indexcount; i += 6) {
+			GLuint base = i / 6 * 4;
+			GLuint* index = &batch_indices[i];
+			index[0] = base;
+			index[1] = base + 1;
+			index[2] = base + 2;
+			index[3] = base + 2;
+			index[4] = base + 3;
+			index[5] = base;
+		}
+		batch_meshes = true;
+	}
+
+	GLuint base = (GLuint)(buffer - batch_start);
+	for (u32 i = 1; i + 1 < count; ++i) {
+		batch_indices[indexcount++] = base;
+		batch_indices[indexcount++] = base + i;
+		batch_indices[indexcount++] = base + i + 1;
+	}
+}
+
+//==========================================================================================
+//Description: Writes a convex polygon into the batch as a triangle fan
+//==========================================================================================
+INTERNAL
+void emit_polygon(const Texture* tex, f32 shape, const vec2* points, const vec2* texcoords, u32 count, vec4 color, u8 depth, u8 blend) {
+	if (!batch_has_room(count, (count - 2) * 3)) {
+		flush_batch(FLUSH_CAPACITY);
+		begin_batch();
+	}
+	f32 texSlot = split_shape(shape, &blend);
+	if (tex != NULL)
+		texSlot = (f32)submit_tex(*tex);
+
+	for (u32 i = 0; i < count; ++i)
+		write_vertex(buffer + i, points[i], color, texcoords[i].x, texcoords[i].y, texSlot, depth, blend);
+	add_polygon_indices(count);
+	buffer += count;
+}
+
+//==========================================================================================
+//Description: Writes the outline of a sprite, its quad or its mesh, as positions and 
+//	texture coordinates and returns the number of points.
+//==========================================================================================
+INTERNAL
+u32 sprite_polygon(const Texture* tex, const SpriteMesh* mesh, f32 x, f32 y, f32 width, f32 height, vec4 uvs, vec2 origin, f32 rotation, vec2* points, vec2* texcoords) {
+	u32 count = 4;
+	vec2 corners[SPRITE_MESH_MAX_POINTS] = { V2(0, 0), V2(0, 1), V2(1, 1), V2(1, 0) };
+	if (mesh != NULL) {
+		count = mesh->count;
+		for (u32 i = 0; i < count; ++i) {
+			//a flipped texture mirrors the polygon, its uvs are flipped already
+			corners[i] = mesh->points[i];
+			if (tex->flip_flag & FLIP_HORIZONTAL)
+				corners[i].x = 1 - corners[i].x;
+			if (tex->flip_flag & FLIP_VERTICAL)
+				corners[i].y = 1 - corners[i].y;
+		}
+	}
+
+	f32 cosine = 1;
+	f32 sine = 0;
+	if (rotation != 0) {
+		f32 rad = deg_to_rad(rotation);
+		cosine = cos(rad);
+		sine = sin(rad);
+	}
+	for (u32 i = 0; i < count; ++i) {
+		vec2 p = corners[i];
+		f32 dx = x + p.x * width - origin.x;
+		f32 dy = y + p.y * height - origin.y;
+		points[i] = V2(cosine * dx - sine * dy + origin.x, sine * dx + cosine * dy + origin.y);
+		texcoords[i] = V2(uvs.x + (uvs.z - uvs.x) * p.x, uvs.y + (uvs.w - uvs.y) * p.y);
+	}
+	return count;
+}
+
+//==========================================================================================
+//Description: Cuts a convex polygon down to the part inside a clip rect, one side of the 
+//	rect at a time (Sutherland-Hodgman), interpolating the texture coordinates.
+//
+//Comments: Returns false and leaves the polygon alone when it is already inside.
+//==========================================================================================
+INTERNAL
+bool clip_polygon(vec2* points, vec2* texcoords, u32* count, const Rect& clip) {
+	bool inside = true;
+	for (u32 i = 0; i < *count; ++i) {
+		if (points[i].x < clip.x || points[i].y < clip.y || points[i].x > clip.x + clip.width || points[i].y > clip.y + clip.height)
+			inside = false;
+	}
+	if (inside)
+		return false;
+
+	//sides as (axis, sign, bound): keep points where sign * point[axis] <= sign * bound
+	const f32 bounds[4] = { clip.x, clip.x + clip.width, clip.y, clip.y + clip.height };
+	vec2 clippedpoints[SPRITE_POLYGON_MAX_POINTS];
+	vec2 clippedcoords[SPRITE_POLYGON_MAX_POINTS];
+	for (u32 side = 0; side < 4 && *count > 0; ++side) {
+		u32 axis = side / 2;
+		f32 sign = (side % 2 == 0) ? -1.0f : 1.0f;
+		f32 bound = bounds[side];
+		u32 n = 0;
+		for (u32 i = 0; i < *count; ++i) {
+			u32 next = (i + 1) % *count;
+			f32 a = sign * ((axis == 0) ? points[i].x : points[i].y) - sign * bound;
+			f32 b = sign * ((axis == 0) ? points[next].x : points[next].y) - sign * bound;
+			if (a <= 0) {
+				clippedpoints[n] = points[i];
+				clippedcoords[n++] = texcoords[i];
+			}
+			if ((a < 0 && b > 0) || (a > 0 && b < 0)) {
+				f32 t = a / (a - b);
+				clippedpoints[n] = V2(points[i].x + (points[next].x - points[i].x) * t, points[i].y + (points[next].y - points[i].y) * t);
+				clippedcoords[n++] = V2(texcoords[i].x + (texcoords[next].x - texcoords[i].x) * t, texcoords[i].y + (texcoords[next].y - texcoords[i].y) * t);
+			}
+		}
+		memcpy(points, clippedpoints, n * sizeof(vec2));
+		memcpy(texcoords, clippedcoords, n * sizeof(vec2));
+		*count = n;
+	}
+	return true;
+}
+
+//==========================================================================================
+//Description: Shrinks an axis-aligned sprite to the part inside a clip rect, moving its 
+//	texture coordinates along with its edges.
+//
+//Comments: Returns false when nothing of the sprite is left.
+//==========================================================================================
+INTERNAL inline
+bool clip_quad(f32* x, f32* y, f32* width, f32* height, vec4* uvs, const Rect& clip) {
+	f32 left = fmax(*x, clip.x);
+	f32 top = fmax(*y, clip.y);
+	f32 right = fmin(*x + *width, clip.x + clip.width);
+	f32 bottom = fmin(*y + *height, clip.y + clip.height);
+	if (right <= left || bottom <= top)
+		return false;
+
+	f32 du = (uvs->z - uvs->x) / *width;
+	f32 dv = (uvs->w - uvs->y) / *height;
+	*uvs = V4(
+		uvs->x + (left - *x) * du, uvs->y + (top - *y) * dv,
+		uvs->x + (right - *x) * du, uvs->y + (bottom - *y) * dv
+	);
+	*x = left;
+	*y = top;
+	*width = right - left;
+	*height = bottom - top;
+	return true;
+}
+
+//==========================================================================================
+//Description: Writes one sprite into the batch.
+//
+//Parameters: 
+//		-A texture to sample (NULL for a flat colored quad)
+//		-The destination rectangle
+//		-Texture coordinates as (left, top, right, bottom)
+//		-A color (RGBA, 0 to 1) to multiply with
+//		-An origin to rotate about and a degree to rotate by
+//		-A shape, layer, blend flags and optionally a mesh to draw instead of the quad
+//		-A rect to clip to, or NULL
+//
+//Comments: Flushes first if the batch is full, so there is no limit on how many
+//		sprites can be drawn between begin2D and end2D. Axis-aligned sprites are clipped
+//		by shrinking the quad, rotated sprites and meshes by cutting their polygon, so 
+//		clipping never needs its own draw call.
+//==========================================================================================
+INTERNAL
+void emit_sprite(const Texture* tex, f32 x, f32 y, f32 width, f32 height, vec4 uvs, vec4 color, vec2 origin, f32 rotation, f32 shape, u8 depth, u8 blend, const SpriteMesh* mesh, const Rect* clip) {
+	bool meshed = mesh != NULL && mesh->count >= 3 && tex != NULL;
+	if (!batch_instanced && (meshed || (clip != NULL && rotation != 0))) {
+		vec2 points[SPRITE_POLYGON_MAX_POINTS];
+		vec2 texcoords[SPRITE_POLYGON_MAX_POINTS];
+		u32 count = sprite_polygon(tex, meshed ? mesh : NULL, x, y, width, height, uvs, origin, rotation, points, texcoords);
+		bool clipped = clip != NULL && clip_polygon(points, texcoords, &count, *clip);
+		if (meshed || clipped) {
+			if (count >= 3)
+				emit_polygon(tex, shape, points, texcoords, count, color, depth, blend);
+			return;
+		}
+	}
+	//the instanced pipeline can only clip sprites that are not rotated
+	if (clip != NULL && rotation == 0 && !clip_quad(&x, &y, &width, &height, &uvs, *clip))
+		return;
+
+	if (!batch_has_room(4, 6) || instances >= instances_end) {
+		flush_batch(FLUSH_CAPACITY);
+		begin_batch();
+	}
+	f32 texSlot = split_shape(shape, &blend);
+	if (tex != NULL)
+		texSlot = (f32)submit_tex(*tex);
+
+	//the instanced pipeline expands and rotates the quad in the vertex shader
+	if (batch_instanced) {
+		instances->rect = V4(x, y, width, height);
+		instances->transform = V4(origin.x - x, origin.y - y, deg_to_rad(rotation), texSlot);
+		instances->uvs = uvs;
+		instances->color = rgba_to_u32(
+			(i32)(color.x * 255.0f + 0.5f), (i32)(color.y * 255.0f + 0.5f),
+			(i32)(color.z * 255.0f + 0.5f), (i32)(color.w * 255.0f + 0.5f)
+		);
+		instances->depth = depth;
+		instances->blend = blend;
+		instances++;
+		indexcount += 6;
+		return;
+	}
+
+	write_quad(buffer, x, y, width, height, uvs, color, origin, rotation, texSlot, depth, blend);
+	add_quad_indices();
+	buffer += 4;
+}
+
+//==========================================================================================
+//Description: Builds a sprite's vertices the way emit_sprite() writes them, but into a 
+//	recording thread's staging buffer, so sorted mode spreads the vertex work over the 
+//	threads that draw. The texture slot is left for emit_staged_sprite() to fill in.
+//
+//Comments: Returns the number of vertices written, 0 if clipping removed the sprite. 
+//		Meshes and clipped rotated sprites are polygons and flagged in polygon.
+//==========================================================================================
+INTERNAL
+u32 stage_sprite(std::vector<VertexData>& out, const Texture* tex, f32 x, f32 y, f32 width, f32 height, vec4 uvs, vec4 color, vec2 origin, f32 rotation, f32 shape, u8 depth, u8 blend, const SpriteMesh* mesh, const Rect* clip, bool* polygon) {
+	*polygon = false;
+	f32 texSlot = split_shape(shape, &blend);
+	bool meshed = mesh != NULL && mesh->count >= 3 && tex != NULL;
+	if (meshed || (clip != NULL && rotation != 0)) {
+		vec2 points[SPRITE_POLYGON_MAX_POINTS];
+		vec2 texcoords[SPRITE_POLYGON_MAX_POINTS];
+		u32 count = sprite_polygon(tex, meshed ? mesh : NULL, x, y, width, height, uvs, origin, rotation, points, texcoords);
+		bool clipped = clip != NULL && clip_polygon(points, texcoords, &count, *clip);
+		if (meshed || clipped) {
+			if (count < 3)
+				return 0;
+			u32 first = out.size();
+			out.resize(first + count);
+			for (u32 i = 0; i < count; ++i)
+				write_vertex(&out[first + i], points[i], color, texcoords[i].x, texcoords[i].y, texSlot, depth, blend);
+			*polygon = true;
+			return count;
+		}
+	}
+	if (clip != NULL && rotation == 0 && !clip_quad(&x, &y, &width, &height, &uvs, *clip))
+		return 0;
+
+	u32 first = out.size();
+	out.resize(first + 4);
+	write_quad(&out[first], x, y, width, height, uvs, color, origin, rotation, texSlot, depth, blend);
+	return 4;
+}
+
+//==========================================================================================
+//Description: Fills in the texture slot of vertices from stage_sprite() and copies them 
+//	into the batch
+//==========================================================================================
+INTERNAL
+void emit_staged_sprite(const SpriteCommand& c) {
+	u32 indices = c.polygon ? (c.vertexcount - 2) * 3 : 6;
+	if (!batch_has_room(c.vertexcount, indices)) {
+		flush_batch(FLUSH_CAPACITY);
+		begin_batch();
+	}
+	if (c.textured) {
+		int texSlot = submit_tex(c.tex);
+		for (u32 i = 0; i < c.vertexcount; ++i)
+			c.vertices[i].texid = texSlot;
+	}
+
+	memcpy(buffer, c.vertices, c.vertexcount * sizeof(VertexData));
+	if (c.polygon)
+		add_polygon_indices(c.vertexcount);
+	else
+		add_quad_indices();
+	buffer += c.vertexcount;
+}
+
+//==========================================================================================
+//Description: Returns true if a sprite is entirely outside an area. Rotated sprites are 
+//	tested with the square that holds every rotation of them about their origin.
+//==========================================================================================
+INTERNAL inline
+bool sprite_outside(f32 x, f32 y, f32 width, f32 height, vec2 origin, f32 rotation, const Rect& area) {
+	f32 left = x, top = y, right = x + width, bottom = y + height;
+	if (rotation != 0) {
+		f32 dx = fmax(fabs(x - origin.x), fabs(x + width - origin.x));
+		f32 dy = fmax(fabs(y - origin.y), fabs(y + height - origin.y));
+		f32 radius = sqrt(dx * dx + dy * dy);
+		left = origin.x - radius;
+		top = origin.y - radius;
+		right = origin.x + radius;
+		bottom = origin.y + radius;
+	}
+	return right <= area.x || left >= area.x + area.width ||
+		bottom <= area.y || top >= area.y + area.height;
+}
+
+INTERNAL inline
+bool sprite_culled(f32 x, f32 y, f32 width, f32 height, vec2 origin, f32 rotation) {
+	return sprite_outside(x, y, width, height, origin, rotation, cull_rect);
+}
+
+//==========================================================================================
+//Description: Returns the calling thread's command list, registering one the first time a
+//	thread records, after its list went back to the pool, or after dispose2D() threw the
+//	old lists away.
+//
+//Comments: The generation is checked first, a list cached from before dispose2D() is 
+//		already deleted. A pooled list may belong to another thread by now, which the 
+//		ticket catches.
+//==========================================================================================
+INTERNAL
+CommandList* get_command_list() {
+	if (local_commands != NULL && local_generation == command_generation && local_commands->owner == local_ticket) {
+		local_commands->used = true;
+		return local_commands;
+	}
+
+	std::lock_guard<std::mutex> lock(command_lists_lock);
+	CommandList* list;
+	if (free_command_lists.empty()) {
+		list = new CommandList();
+	}
+	else {
+		list = free_command_lists.back();
+		free_command_lists.pop_back();
+	}
+	list->commands.clear();
+	list->keys.clear();
+	list->vertices.clear();
+	list->stream = 0;
+	list->layer = 0;
+	list->opaque = false;
+	list->blend = BLEND_ALPHA;
+	list->clips.clear();
+	list->emitted = list->culled = 0;
+	list->owner = ++command_tickets;
+	list->used = true;
+	command_lists.push_back(list);
+	local_commands = list;
+	local_generation = command_generation;
+	local_ticket = list->owner;
+	return list;
+}
+
+INTERNAL inline
+bool list_order(const CommandList* first, const CommandList* second) {
+	return first->stream < second->stream;
+}
+
+//==========================================================================================
+//Description: Concatenates every thread's commands in stream order into commands and
+//	sort_keys, rebasing each key's index onto the merged array.
+//==========================================================================================
+INTERNAL
+void merge_command_lists() {
+	std::lock_guard<std::mutex> lock(command_lists_lock);
+	//stable, so threads that share a stream keep the order they registered in
+	std::stable_sort(command_lists.begin(), command_lists.end(), list_order);
+	for (u32 i = 0; i < command_lists.size(); ++i) {
+		CommandList* list = command_lists[i];
+		u64 base = commands.size();
+		for (u32 j = 0; j < list->keys.size(); ++j)
+			sort_keys.push_back(list->keys[j] + base);
+		commands.insert(commands.end(), list->commands.begin(), list->commands.end());
+		//the staged vertices stay in the list until emit_sorted_commands() is done with them
+		for (u64 j = base; j < commands.size(); ++j) {
+			if (commands[j].staged)
+				commands[j].vertices = &list->vertices[commands[j].first];
+		}
+		frame_stats.emitted += list->emitted;
+		frame_stats.culled += list->culled;
+
+		list->commands.clear();
+		list->keys.clear();
+		list->emitted = list->culled = 0;
+	}
+}
+
+//==========================================================================================
+//Description: Drops the vertices staged for the commands emit_sorted_commands() just drew
+//==========================================================================================
+INTERNAL
+void clear_staged_vertices() {
+	std::lock_guard<std::mutex> lock(command_lists_lock);
+	for (u32 i = 0; i < command_lists.size(); ++i)
+		command_lists[i]->vertices.clear();
+}
+
+//==========================================================================================
+//Description: Clears every thread's list for a new pass. Lists whose thread did not call
+//	into the renderer during the last pass go back to the pool, so threads started for a
+//	single frame do not leave a list behind each.
+//==========================================================================================
+INTERNAL
+void reset_command_lists() {
+	std::lock_guard<std::mutex> lock(command_lists_lock);
+	u32 kept = 0;
+	for (u32 i = 0; i < command_lists.size(); ++i) {
+		CommandList* list = command_lists[i];
+		if (!list->used) {
+			list->owner = 0;
+			free_command_lists.push_back(list);
+			continue;
+		}
+		command_lists[kept++] = list;
+		list->used = false;
+		list->commands.clear();
+		list->keys.clear();
+		list->vertices.clear();
+		list->layer = 0;
+		list->opaque = false;
+		list->blend = BLEND_ALPHA;
+		list->clips.clear();
+		list->emitted = list->culled = 0;
+	}
+	command_lists.resize(kept);
+	commands.clear();
+	sort_keys.clear();
+}
+
+//==========================================================================================
+//Description: Entry point of every draw call. Writes the sprite into the batch, or records
+//	it for end2D() to sort when the batch was begun in sorted mode.
+//==========================================================================================
+INTERNAL
+void push_sprite(const Texture* tex, f32 x, f32 y, f32 width, f32 height, vec4 uvs, vec4 color, vec2 origin, f32 rotation, f32 shape = 0, const SpriteMesh* mesh = NULL) {
+	CommandList* list = get_command_list();
+	u8 blend = list->blend;
+	if (tex != NULL && tex->premultiplied)
+		blend |= BLEND_PREMULTIPLIED_TEXTURE;
+	const Rect* clip = list->clips.empty() ? NULL : &list->clips.back();
+	bool dropped = (culling && sprite_culled(x, y, width, height, origin, rotation)) ||
+		(clip != NULL && sprite_outside(x, y, width, height, origin, rotation, *clip));
+
+	if (!batch_sorted) {
+		if (std::this_thread::get_id() != gl_thread) {
+			BMT_LOG(WARNING, "2D draw calls from other threads need a batch begun in sorted mode");
+			return;
+		}
+		if (dropped) {
+			frame_stats.culled++;
+			return;
+		}
+		frame_stats.emitted++;
+		f64 start = begin_emit_timer();
+		emit_sprite(tex, x, y, width, height, uvs, color, origin, rotation, shape, list->layer, blend, mesh, clip);
+		end_emit_timer(start);
+		return;
+	}
+
+	if (dropped) {
+		list->culled++;
+		return;
+	}
+	list->emitted++;
+
+	SpriteCommand command;
+	command.textured = tex != NULL;
+	if (tex != NULL)
+		command.tex = *tex;
+	command.x = x;
+	command.y = y;
+	command.width = width;
+	command.height = height;
+	command.uvs = uvs;
+	command.color = color;
+	command.origin = origin;
+	command.rotation = rotation;
+	command.shape = shape;
+	command.depth = list->layer;
+	command.blend = blend;
+	command.mesh = mesh;
+	command.clipped = clip != NULL;
+	if (clip != NULL)
+		command.clip = *clip;
+	command.staged = !batch_instanced;
+	command.polygon = false;
+	command.vertexcount = 0;
+	command.vertices = NULL;
+	if (command.staged) {
+		command.first = list->vertices.size();
+		command.vertexcount = stage_sprite(list->vertices, tex, x, y, width, height, uvs, color, origin, rotation, shape, list->layer, blend, mesh, clip, &command.polygon);
+		if (command.vertexcount == 0)
+			return;
+	}
+
+	//an opaque sprite must cover its whole quad, so shapes and additive sprites never are
+	bool opaque = batch_depth && shape == 0 && color.w >= 1 && list->blend == BLEND_ALPHA && (tex == NULL || list->opaque);
+	u64 layerkey = opaque ? (u64)(255 - list->layer) : (u64)list->layer;
+	u64 texkey = (tex != NULL) ? (tex->ID & SORT_KEY_TEXTURE_MASK) : 0;
+	u64 key = (opaque ? 0 : SORT_KEY_TRANSLUCENT) | (layerkey << SORT_KEY_LAYER_SHIFT) | (texkey << SORT_KEY_TEXTURE_SHIFT) | (u64)list->commands.size();
+	list->commands.push_back(command);
+	list->keys.push_back(key);
+}
+
+//==========================================================================================
+//Description: Sorts the recorded keys with an 8 bit LSD radix sort. Passes over a byte
+//	that is the same in every key are skipped, which is most of them in a typical frame.
+//==========================================================================================
+INTERNAL
+void radix_sort_keys() {
+	u32 count = sort_keys.size();
+	if (count < 2)
+		return;
+	sort_scratch.resize(count);
+	u64* src = &sort_keys[0];
+	u64* dst = &sort_scratch[0];
+
+	for (u32 shift = 0; shift < 64; shift += 8) {
+		u32 histogram[256] = { 0 };
+		for (u32 i = 0; i < count; ++i)
+			histogram[(src[i] >> shift) & 0xFF]++;
+		if (histogram[(src[0] >> shift) & 0xFF] == count)
+			continue;
+
+		u32 offset = 0;
+		for (u32 i = 0; i < 256; ++i) {
+			u32 bucket = histogram[i];
+			histogram[i] = offset;
+			offset += bucket;
+		}
+		for (u32 i = 0; i < count; ++i)
+			dst[histogram[(src[i] >> shift) & 0xFF]++] = src[i];
+
+		u64* temp = src;
+		src = dst;
+		dst = temp;
+	}
+	if (src != &sort_keys[0])
+		memcpy(&sort_keys[0], src, count * sizeof(u64));
+}
+
+//==========================================================================================
+//Description: Sorts the commands every thread recorded since begin2D() and writes them 
+//	into the batch.
+//
+//Comments: With depth testing the opaque commands are drawn first with depth writes and
+//		without blending. The batch is flushed at the first translucent command, which
+//		is then drawn with blending and without depth writes.
+//==========================================================================================
+INTERNAL
+void emit_sorted_commands() {
+	f64 start = begin_emit_timer();
+	merge_command_lists();
+	radix_sort_keys();
+
+	bool translucent = !batch_depth;
+	if (batch_depth) {
+		glDisable(GL_BLEND);
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LEQUAL);
+	}
+	for (u32 i = 0; i < sort_keys.size(); ++i) {
+		if (!translucent && (sort_keys[i] & SORT_KEY_TRANSLUCENT)) {
+			translucent = true;
+			flush_batch(FLUSH_EXPLICIT);
+			begin_batch();
+			if (batch_blending)
+				glEnable(GL_BLEND);
+			glDepthMask(GL_FALSE);
+		}
+		const SpriteCommand& c = commands[sort_keys[i] & SORT_KEY_INDEX_MASK];
+		if (c.staged)
+			emit_staged_sprite(c);
+		else
+			emit_sprite(c.textured ? &c.tex : NULL, c.x, c.y, c.width, c.height, c.uvs, c.color, c.origin, c.rotation, c.shape, c.depth, c.blend, c.mesh, c.clipped ? &c.clip : NULL);
+	}
+	if (!translucent) {
+		flush_batch(FLUSH_EXPLICIT);
+		begin_batch();
+		if (batch_blending)
+			glEnable(GL_BLEND);
+		glDepthMask(GL_FALSE);
+	}
+	commands.clear();
+	sort_keys.clear();
+	clear_staged_vertices();
+	end_emit_timer(start);
+}
+
+INTERNAL
+void release_batch_buffers() {
+	dispose_stream_ring(ring);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteVertexArrays(1, &instance_vao);
+	glDeleteBuffers(1, &ebo);
+	glDeleteBuffers(1, &mesh_ebo);
+	vao = instance_vao = ebo = mesh_ebo = 0;
+}
+
+Shader load_default_shader_2D() {
+	return load_shader_2D_from_strings(ORTHO_SHADER_VERT_SHADER, ORTHO_SHADER_FRAG_SHADER);
+}
+
+INTERNAL
+Shader load_instanced_shader_2D_from_strings(const GLchar* vertexstring, const GLchar* fragmentstring) {
+	Shader instanced = load_shader_2D_from_strings(vertexstring, fragmentstring);
+	glBindAttribLocation(instanced.ID, 0, "instance_rect");
+	glBindAttribLocation(instanced.ID, 1, "instance_transform");
+	glBindAttribLocation(instanced.ID, 2, "instance_uvs");
+	glBindAttribLocation(instanced.ID, 3, "instance_color");
+	glBindAttribLocation(instanced.ID, 4, "instance_depth");
+	glBindAttribLocation(instanced.ID, 5, "instance_blend");
+	glLinkProgram(instanced.ID);
+	glValidateProgram(instanced.ID);
+	return instanced;
+}
+
+Shader load_instanced_shader_2D() {
+	return load_instanced_shader_2D_from_strings(INSTANCED_SHADER_VERT_SHADER, ORTHO_SHADER_FRAG_SHADER);
+}
+
+Shader load_array_shader_2D(bool instanced) {
+	if (instanced)
+		return load_instanced_shader_2D_from_strings(INSTANCED_SHADER_VERT_SHADER, ARRAY_SHADER_FRAG_SHADER);
+	return load_shader_2D_from_strings(ORTHO_SHADER_VERT_SHADER, ARRAY_SHADER_FRAG_SHADER);
+}
+
+void init2D(i32 x, i32 y, u32 width, u32 height, u32 capacity) {
+	//init2D can be called again (after init_window) to resize the batch
+	if (vao != 0)
+		release_batch_buffers();
+
+	texcount = indexcount = 0;
+	cull_rect = rect(x, y, width, height);
+	view_area = cull_rect;
+	if (capacity == 0)
+		capacity = BATCH_MAX_SPRITES;
+	batch_capacity = capacity;
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	create_stream_ring(ring, (GLsizeiptr)capacity * BATCH_SPRITE_SIZE);
+	if (ring.persistent)
+		BMT_LOG(INFO, "2D batch is streaming through a persistently mapped ring buffer");
+	else
+		BMT_LOG(INFO, "2D batch is streaming through unsynchronized ring buffer maps");
+	set_vertex_attribs(0);
+
+	ebo = create_quad_index_buffer(capacity, &batch_index_type);
+	glGenBuffers(1, &mesh_ebo);
+	batch_indices.resize(capacity * 6);
+
+	//the vao must be unbound before the buffers
+	glBindVertexArray(0);
+
+	timer_queries_supported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+	if (timer_queries_supported && stats_queries[0][0] == 0)
+		glGenQueries(RENDER_STATS_QUERY_FRAMES * RENDER_STATS_QUERIES, &stats_queries[0][0]);
+
+	//the instanced pipeline reads one record per quad and needs no element buffer
+	instancing_supported = GLEW_VERSION_3_3 || GLEW_ARB_instanced_arrays;
+	batch_instanced = false;
+	if (instancing_supported) {
+		glGenVertexArrays(1, &instance_vao);
+		glBindVertexArray(instance_vao);
+		set_instance_attribs(0);
+		for (u32 i = 0; i < 6; ++i)
+			glVertexAttribDivisor(i, 1);
+		glBindVertexArray(0);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void begin2D(Shader shader_in, bool blending, bool depthTest, bool sorted) {
+	shader = shader_in;
+	start_shader(shader_in);
+
+	if (blending)
+		glEnable(GL_BLEND);
+	else
+		glDisable(GL_BLEND);
+	if (depthTest)
+		glEnable(GL_DEPTH_TEST);
+	else
+		glDisable(GL_DEPTH_TEST);
+
+	batch_instanced = glGetAttribLocation(shader.ID, "instance_rect") != -1;
+	batch_arrayed = glGetUniformLocation(shader.ID, "layers") != -1;
+	bound_array = 0;
+	if (batch_instanced && !instancing_supported) {
+		BMT_LOG(WARNING, "Instanced 2D shader used but instanced arrays are not supported");
+		batch_instanced = false;
+	}
+
+	batch_premultiplied = glGetAttribLocation(shader.ID, batch_instanced ? "instance_blend" : "blend") != -1;
+	if (batch_premultiplied)
+		glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	else //alpha adds up as coverage, so drawing into a transparent target (see RenderLayer) works too
+		glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	batch_sorted = sorted;
+	batch_depth = sorted && depthTest;
+	if (batch_depth)
+		glGetIntegerv(GL_DEPTH_FUNC, &saved_depth_func);
+	batch_blending = blending;
+	gl_thread = std::this_thread::get_id();
+	frame_stats.passes++;
+	reset_command_lists();
+
+	if (camera_set) {
+		upload_mat4(shader, "view", view_matrix);
+		cull_rect = camera_cull;
+	}
+	batch_open = true;
+
+	begin_batch();
+}
+
+void set_layer_2D(u8 layer) {
+	get_command_list()->layer = layer;
+}
+
+void set_opaque_2D(bool opaque) {
+	get_command_list()->opaque = opaque;
+}
+
+void set_blend_mode_2D(u8 mode) {
+	get_command_list()->blend = (mode == BLEND_ADDITIVE) ? BLEND_ADDITIVE : BLEND_ALPHA;
+}
+
+void push_clip_rect(Rect area) {
+	CommandList* list = get_command_list();
+	if (!list->clips.empty()) {
+		const Rect& outer = list->clips.back();
+		f32 left = fmax(area.x, outer.x);
+		f32 top = fmax(area.y, outer.y);
+		f32 right = fmin(area.x + area.width, outer.x + outer.width);
+		f32 bottom = fmin(area.y + area.height, outer.y + outer.height);
+		area = rect(left, top, fmax(right - left, 0.0f), fmax(bottom - top, 0.0f));
+	}
+	list->clips.push_back(area);
+}
+
+void pop_clip_rect() {
+	CommandList* list = get_command_list();
+	if (list->clips.empty()) {
+		BMT_LOG(WARNING, "pop_clip_rect called without a matching push_clip_rect");
+		return;
+	}
+	list->clips.pop_back();
+}
+
+void set_command_stream_2D(u32 stream) {
+	get_command_list()->stream = stream;
+}
+
+void set_culling_2D(bool enabled) {
+	culling = enabled;
+}
+
+void set_cull_rect_2D(Rect area) {
+	cull_rect = area;
+}
+
+Rect get_cull_rect_2D() {
+	return cull_rect;
+}
+
+Camera2D create_camera_2D(f32 x, f32 y, f32 zoom, f32 rotation) {
+	Camera2D camera;
+	camera.position = V2(x, y);
+	camera.zoom = zoom;
+	camera.rotation = rotation;
+	return camera;
+}
+
+mat4 camera_view_matrix_2D(const Camera2D& camera) {
+	//screen = center + zoom * rotate(-rotation) * (world - position)
+	f32 rad = deg_to_rad(camera.rotation);
+	f32 c = cos(rad) * camera.zoom;
+	f32 s = sin(rad) * camera.zoom;
+	vec2 center = V2(view_area.x + view_area.width / 2, view_area.y + view_area.height / 2);
+
+	mat4 mat = identity();
+	mat.elements[0 + 0 * 4] = c;
+	mat.elements[1 + 0 * 4] = -s;
+	mat.elements[0 + 1 * 4] = s;
+	mat.elements[1 + 1 * 4] = c;
+	mat.elements[0 + 3 * 4] = center.x - (c * camera.position.x + s * camera.position.y);
+	mat.elements[1 + 3 * 4] = center.y - (-s * camera.position.x + c * camera.position.y);
+	return mat;
+}
+
+vec2 world_to_screen_2D(const Camera2D& camera, vec2 point) {
+	mat4 mat = camera_view_matrix_2D(camera);
+	return V2(
+		mat.elements[0] * point.x + mat.elements[4] * point.y + mat.elements[12],
+		mat.elements[1] * point.x + mat.elements[5] * point.y + mat.elements[13]
+	);
+}
+
+vec2 screen_to_world_2D(const Camera2D& camera, vec2 point) {
+	f32 rad = deg_to_rad(camera.rotation);
+	f32 c = cos(rad);
+	f32 s = sin(rad);
+	f32 dx = (point.x - (view_area.x + view_area.width / 2)) / camera.zoom;
+	f32 dy = (point.y - (view_area.y + view_area.height / 2)) / camera.zoom;
+	return V2(camera.position.x + c * dx - s * dy, camera.position.y + s * dx + c * dy);
+}
+
+Rect get_camera_rect_2D(const Camera2D& camera) {
+	vec2 corners[4] = {
+		screen_to_world_2D(camera, V2(view_area.x, view_area.y)),
+		screen_to_world_2D(camera, V2(view_area.x + view_area.width, view_area.y)),
+		screen_to_world_2D(camera, V2(view_area.x, view_area.y + view_area.height)),
+		screen_to_world_2D(camera, V2(view_area.x + view_area.width, view_area.y + view_area.height))
+	};
+	f32 left = corners[0].x, top = corners[0].y, right = corners[0].x, bottom = corners[0].y;
+	for (u32 i = 1; i < 4; ++i) {
+		left = fmin(left, corners[i].x);
+		top = fmin(top, corners[i].y);
+		right = fmax(right, corners[i].x);
+		bottom = fmax(bottom, corners[i].y);
 	}
-	return texSlot;
+	return rect(left, top, right - left, bottom - top);
 }
 
-Shader load_default_shader_2D() {
-	return load_shader_2D_from_strings(ORTHO_SHADER_VERT_SHADER, ORTHO_SHADER_FRAG_SHADER);
+//==========================================================================================
+//Description: Switches the view matrix and cull rect, drawing what the pass batched with 
+//	the previous view first.
+//==========================================================================================
+INTERNAL
+void apply_view_2D(const mat4& view, Rect cull) {
+	if (batch_open) {
+		if (batch_sorted)
+			emit_sorted_commands();
+		flush_batch(FLUSH_EXPLICIT);
+		begin_batch();
+		upload_mat4(shader, "view", view);
+		cull_rect = cull;
+	}
+	view_matrix = view;
+	camera_cull = cull;
+	camera_set = true;
 }
 
-void init2D(i32 x, i32 y, u32 width, u32 height) {
-	texcount = indexcount = 0;
+void set_camera_2D(const Camera2D& camera) {
+	apply_view_2D(camera_view_matrix_2D(camera), get_camera_rect_2D(camera));
+}
 
-	locations[0] = "tex1";
-	locations[1] = "tex2";
-	locations[2] = "tex3";
-	locations[3] = "tex4";
-	locations[4] = "tex5";
-	locations[5] = "tex6";
-	locations[6] = "tex7";
-	locations[7] = "tex8";
-	locations[8] = "tex9";
-	locations[9] = "tex10";
-	locations[10] = "tex11";
-	locations[11] = "tex12";
-	locations[12] = "tex13";
-	locations[13] = "tex14";
-	locations[14] = "tex15";
-	locations[15] = "tex16";
+void reset_camera_2D() {
+	apply_view_2D(identity(), view_area);
+}
 
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+Render2DStats get_render_stats_2D() {
+	return last_frame_stats;
+}
 
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, BATCH_BUFFER_SIZE, NULL, GL_DYNAMIC_DRAW);
+Render2DStats get_frame_stats_2D() {
+	return frame_stats;
+}
 
-	//the last argument to glVertexAttribPointer is the offset from the start of the vertex to the
-	//data you want to look at - so each new attrib adds up all the ones before it.
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, BATCH_VERTEX_SIZE, (const GLvoid*)0);                     //vertices
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, BATCH_VERTEX_SIZE, (const GLvoid*)(2 * sizeof(GLfloat))); //color
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, BATCH_VERTEX_SIZE, (const GLvoid*)(6 * sizeof(GLfloat))); //tex coords
-	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, BATCH_VERTEX_SIZE, (const GLvoid*)(8 * sizeof(GLfloat))); //texture id
+void set_render_timing_2D(bool enabled) {
+	stats_timing = enabled;
+}
 
-	GLushort indices[BATCH_INDICE_SIZE];
+//==========================================================================================
+//Description: Reads back the GPU timers of the frame that last used the query slot the
+//	next frame is about to use. Results that are not ready yet are dropped instead of 
+//	waited on.
+//==========================================================================================
+INTERNAL
+void collect_gpu_timers(u64 frame) {
+	u32 slot = frame % RENDER_STATS_QUERY_FRAMES;
+	u32 count = stats_query_count[slot];
+	stats_query_count[slot] = 0;
+	if (count == 0)
+		return;
 
-	int offset = 0;
-	for (u32 i = 0; i < BATCH_INDICE_SIZE; i += 6) {
-		indices[i] = offset + 0;
-		indices[i + 1] = offset + 1;
-		indices[i + 2] = offset + 2;
-		indices[i + 3] = offset + 2;
-		indices[i + 4] = offset + 3;
-		indices[i + 5] = offset + 0;
+	GLint available = 0;
+	glGetQueryObjectiv(stats_queries[slot][count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return;
 
-		offset += 4;
+	GLuint64 nanoseconds = 0;
+	for (u32 i = 0; i < count; ++i) {
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(stats_queries[slot][i], GL_QUERY_RESULT, &elapsed);
+		nanoseconds += elapsed;
 	}
+	f32 ms = (f32)(nanoseconds / 1000000.0);
+	stats_history[frame % RENDER_STATS_HISTORY].gpu_ms = ms;
+	last_frame_stats.gpu_ms = ms;
+}
 
-	glGenBuffers(1, &ebo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, BATCH_INDICE_SIZE * sizeof(GLushort), indices, GL_STATIC_DRAW);
+void end_frame_2D() {
+	fence_stream_ring(ring);
+	frame_stats.gpu_ms = -1;
+	stats_history[stats_frame % RENDER_STATS_HISTORY] = frame_stats;
+	f32 gpu = last_frame_stats.gpu_ms;
+	last_frame_stats = frame_stats;
+	last_frame_stats.gpu_ms = gpu;
+
+	stats_frame++;
+	if (stats_frame >= RENDER_STATS_QUERY_FRAMES)
+		collect_gpu_timers(stats_frame - RENDER_STATS_QUERY_FRAMES);
+	else
+		stats_query_count[stats_frame % RENDER_STATS_QUERY_FRAMES] = 0;
 
-	//the vao must be unbound before the buffers
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	memset(&frame_stats, 0, sizeof(Render2DStats));
+	frame_textures.clear();
 }
 
-void begin2D(Shader shader_in, bool blending, bool depthTest) {
-	shader = shader_in;
-	start_shader(shader_in);
-
-	if (blending)
-		glEnable(GL_BLEND);
-	else
-		glDisable(GL_BLEND);
-	if (depthTest)
-		glEnable(GL_DEPTH_TEST);
-	else
-		glDisable(GL_DEPTH_TEST);
+u32 get_render_stats_history_2D(Render2DStats* stats, u32 count) {
+	u32 available = (stats_frame < RENDER_STATS_HISTORY) ? (u32)stats_frame : RENDER_STATS_HISTORY;
+	if (count > available)
+		count = available;
+	for (u32 i = 0; i < count; ++i)
+		stats[i] = stats_history[(stats_frame - count + i) % RENDER_STATS_HISTORY];
+	return count;
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	buffer = (VertexData*)glMapBufferRange(GL_ARRAY_BUFFER, 0, BATCH_BUFFER_SIZE,
-		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
+void dump_render_stats_2D(const char* filepath) {
+	FILE* file = fopen(filepath, "w");
+	if (file == NULL) {
+		BMT_LOG(WARNING, "[%s] Could not open file to dump 2D render stats", filepath);
+		return;
+	}
+	fprintf(file, "frame,passes,drawcalls,flushes_textures,flushes_capacity,flushes_explicit,"
+		"quads,emitted,culled,bytes_uploaded,textures,emit_ms,gpu_ms\n"
 	);
+	u32 available = (stats_frame < RENDER_STATS_HISTORY) ? (u32)stats_frame : RENDER_STATS_HISTORY;
+	for (u64 frame = stats_frame - available; frame < stats_frame; ++frame) {
+		const Render2DStats& stats = stats_history[frame % RENDER_STATS_HISTORY];
+		fprintf(file, "%llu,%u,%u,%u,%u,%u,%u,%u,%u,%llu,%u,%.3f,%.3f\n", (unsigned long long)frame,
+			stats.passes, stats.drawcalls, stats.flushes_textures, stats.flushes_capacity, stats.flushes_explicit,
+			stats.quads, stats.emitted, stats.culled, (unsigned long long)stats.bytes_uploaded, stats.textures,
+			stats.emit_ms, stats.gpu_ms
+		);
+	}
+	fclose(file);
+	BMT_LOG(INFO, "[%s] Dumped 2D render stats of %d frames", filepath, available);
 }
 
 void draw_texture(Texture tex, i32 xPos, i32 yPos) {
 	if (tex.ID == 0)
 		return;
-	int texSlot = submit_tex(tex);
-	GLfloat* uvs;
-
-	uvs = DEFAULT_UVS;
-	if (tex.flip_flag & FLIP_HORIZONTAL && tex.flip_flag & FLIP_VERTICAL)
-		uvs = FLIP_BOTH_UVS;
-	if (tex.flip_flag & FLIP_HORIZONTAL)
-		uvs = FLIP_HORIZONTAL_UVS;
-	if (tex.flip_flag & FLIP_VERTICAL)
-		uvs = FLIP_VERTICAL_UVS;
-
-	buffer->pos.x = xPos;
-	buffer->pos.y = yPos;
-	buffer->color.x = 1;
-	buffer->color.y = 1;
-	buffer->color.z = 1;
-	buffer->color.w = 1;
-	buffer->uv.x = uvs[0];
-	buffer->uv.y = uvs[1];
-	buffer->texid = texSlot;
-	buffer++;
-
-	buffer->pos.x = xPos;
-	buffer->pos.y = yPos + tex.height;
-	buffer->color.x = 1;
-	buffer->color.y = 1;
-	buffer->color.z = 1;
-	buffer->color.w = 1;
-	buffer->uv.x = uvs[2];
-	buffer->uv.y = uvs[3];
-	buffer->texid = texSlot;
-	buffer++;
-
-	buffer->pos.x = xPos + tex.width;
-	buffer->pos.y = yPos + tex.height;
-	buffer->color.x = 1;
-	buffer->color.y = 1;
-	buffer->color.z = 1;
-	buffer->color.w = 1;
-	buffer->uv.x = uvs[4];
-	buffer->uv.y = uvs[5];
-	buffer->texid = texSlot;
-	buffer++;
-
-	buffer->pos.x = xPos + tex.width;
-	buffer->pos.y = yPos;
-	buffer->color.x = 1;
-	buffer->color.y = 1;
-	buffer->color.z = 1;
-	buffer->color.w = 1;
-	buffer->uv.x = uvs[6];
-	buffer->uv.y = uvs[7];
-	buffer->texid = texSlot;
-	buffer++;
-
-	indexcount += 6;
+	push_sprite(&tex, xPos, yPos, tex.width, tex.height, texture_uvs(tex, 0, 0, 1, 1),
+		V4(1, 1, 1, 1), V2(0, 0), 0
+	);
 }
 
 void draw_texture(Texture tex, i32 xPos, i32 yPos, i32 width, i32 height) {
 	if (tex.ID == 0)
 		return;
-	int texSlot = submit_tex(tex);
-	GLfloat* uvs;
-
-	uvs = DEFAULT_UVS;
-	if (tex.flip_flag & FLIP_HORIZONTAL && tex.flip_flag & FLIP_VERTICAL)
-		uvs = FLIP_BOTH_UVS;
-	if (tex.flip_flag & FLIP_HORIZONTAL)
-		uvs = FLIP_HORIZONTAL_UVS;
-	if (tex.flip_flag & FLIP_VERTICAL)
-		uvs = FLIP_VERTICAL_UVS;
-
-	buffer->pos.x = xPos;
-	buffer->pos.y = yPos;
-	buffer->color.x = 1;
-	buffer->color.y = 1;
-	buffer->color.z = 1;
-	buffer->color.w = 1;
-	buffer->uv.x = uvs[0];
-	buffer->uv.y = uvs[1];
-	buffer->texid = texSlot;
-	buffer++;
-
-	buffer->pos.x = xPos;
-	buffer->pos.y = yPos + height;
-	buffer->color.x = 1;
-	buffer->color.y = 1;
-	buffer->color.z = 1;
-	buffer->color.w = 1;
-	buffer->uv.x = uvs[2];
-	buffer->uv.y = uvs[3];
-	buffer->texid = texSlot;
-	buffer++;
-
-	buffer->pos.x = xPos + width;
-	buffer->pos.y = yPos + height;
-	buffer->color.x = 1;
-	buffer->color.y = 1;
-	buffer->color.z = 1;
-	buffer->color.w = 1;
-	buffer->uv.x = uvs[4];
-	buffer->uv.y = uvs[5];
-	buffer->texid = texSlot;
-	buffer++;
-
-	buffer->pos.x = xPos + width;
-	buffer->pos.y = yPos;
-	buffer->color.x = 1;
-	buffer->color.y = 1;
-	buffer->color.z = 1;
-	buffer->color.w = 1;
-	buffer->uv.x = uvs[6];
-	buffer->uv.y = uvs[7];
-	buffer->texid = texSlot;
-	buffer++;
-
-	indexcount += 6;
+	push_sprite(&tex, xPos, yPos, width, height, texture_uvs(tex, 0, 0, 1, 1),
+		V4(1, 1, 1, 1), V2(0, 0), 0
+	);
 }
 
 void draw_texture(Texture tex, i32 xPos, i32 yPos, vec4 color) {
@@ -369,68 +1734,9 @@ void draw_texture(Texture tex, i32 xPos, i32 yPos, vec4 color) {
 void draw_texture(Texture tex, i32 xPos, i32 yPos, f32 r, f32 g, f32 b, f32 a) {
 	if (tex.ID == 0)
 		return;
-
-	r /= 255;
-	g /= 255;
-	b /= 255;
-	a /= 255;
-
-	int texSlot = submit_tex(tex);
-	GLfloat* uvs;
-
-	uvs = DEFAULT_UVS;
-	if (tex.flip_flag & FLIP_HORIZONTAL && tex.flip_flag & FLIP_VERTICAL)
-		uvs = FLIP_BOTH_UVS;
-	if (tex.flip_flag & FLIP_HORIZONTAL)
-		uvs = FLIP_HORIZONTAL_UVS;
-	if (tex.flip_flag & FLIP_VERTICAL)
-		uvs = FLIP_VERTICAL_UVS;
-
-	buffer->pos.x = xPos;
-	buffer->pos.y = yPos;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = uvs[0];
-	buffer->uv.y = uvs[1];
-	buffer->texid = texSlot;
-	buffer++;
-
-	buffer->pos.x = xPos;
-	buffer->pos.y = yPos + tex.height;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = uvs[2];
-	buffer->uv.y = uvs[3];
-	buffer->texid = texSlot;
-	buffer++;
-
-	buffer->pos.x = xPos + tex.width;
-	buffer->pos.y = yPos + tex.height;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = uvs[4];
-	buffer->uv.y = uvs[5];
-	buffer->texid = texSlot;
-	buffer++;
-
-	buffer->pos.x = xPos + tex.width;
-	buffer->pos.y = yPos;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = uvs[6];
-	buffer->uv.y = uvs[7];
-	buffer->texid = texSlot;
-	buffer++;
-
-	indexcount += 6;
+	push_sprite(&tex, xPos, yPos, tex.width, tex.height, texture_uvs(tex, 0, 0, 1, 1),
+		V4(r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f), V2(0, 0), 0
+	);
 }
 
 void draw_texture_rotated(Texture tex, i32 xPos, i32 yPos, f32 rotateDegree) {
@@ -442,259 +1748,22 @@ void draw_texture_rotated(Texture tex, i32 xPos, i32 yPos, f32 rotateDegree) {
 void draw_texture_rotated(Texture tex, i32 xPos, i32 yPos, vec2 origin, f32 rotation) {
 	if (tex.ID == 0)
 		return;
-	int texSlot = submit_tex(tex);
-	GLfloat* uvs;
-	
-	uvs = DEFAULT_UVS;
-	if (tex.flip_flag & FLIP_HORIZONTAL && tex.flip_flag & FLIP_VERTICAL)
-		uvs = FLIP_BOTH_UVS;
-	if (tex.flip_flag & FLIP_HORIZONTAL)
-		uvs = FLIP_HORIZONTAL_UVS;
-	if (tex.flip_flag & FLIP_VERTICAL)
-		uvs = FLIP_VERTICAL_UVS;
-	
-	float originX = origin.x;
-	float originY = origin.y;
-	
-	//degToRad is expensive don't do it if there is no rotation
-	if (rotation != 0)
-		rotation = deg_to_rad(rotation);
-	
-	float newX;
-	float newY;
-	
-	float cosineDegree = 1;
-	float sineDegree = 0;
-	//sin and cos are expensive don't do it if there is no rotation
-	if (rotation != 0) {
-		cosineDegree = cos(rotation);
-		sineDegree = sin(rotation);
-	}
-	
-	newX = xPos;
-	newY = yPos;
-	buffer->pos.x = cosineDegree * (newX - originX) - sineDegree * (newY - originY) + originX;
-	buffer->pos.y = sineDegree * (newX - originX) + cosineDegree * (newY - originY) + originY;
-	buffer->color.x = 1;
-	buffer->color.y = 1;
-	buffer->color.z = 1;
-	buffer->color.w = 1;
-	buffer->uv.x = uvs[0];
-	buffer->uv.y = uvs[1];
-	buffer->texid = texSlot;
-	buffer++;
-	
-	newX = xPos;
-	newY = yPos + tex.height;
-	buffer->pos.x = cosineDegree * (newX - originX) - sineDegree * (newY - originY) + originX;
-	buffer->pos.y = sineDegree * (newX - originX) + cosineDegree * (newY - originY) + originY;
-	buffer->color.x = 1;
-	buffer->color.y = 1;
-	buffer->color.z = 1;
-	buffer->color.w = 1;
-	buffer->uv.x = uvs[2];
-	buffer->uv.y = uvs[3];
-	buffer->texid = texSlot;
-	buffer++;
-	
-	newX = xPos + tex.width;
-	newY = yPos + tex.height;
-	buffer->pos.x = cosineDegree * (newX - originX) - sineDegree * (newY - originY) + originX;
-	buffer->pos.y = sineDegree * (newX - originX) + cosineDegree * (newY - originY) + originY;
-	buffer->color.x = 1;
-	buffer->color.y = 1;
-	buffer->color.z = 1;
-	buffer->color.w = 1;
-	buffer->uv.x = uvs[4];
-	buffer->uv.y = uvs[5];
-	buffer->texid = texSlot;
-	buffer++;
-	
-	newX = xPos + tex.width;
-	newY = yPos;
-	buffer->pos.x = cosineDegree * (newX - originX) - sineDegree * (newY - originY) + originX;
-	buffer->pos.y = sineDegree * (newX - originX) + cosineDegree * (newY - originY) + originY;
-	buffer->color.x = 1;
-	buffer->color.y = 1;
-	buffer->color.z = 1;
-	buffer->color.w = 1;
-	buffer->uv.x = uvs[6];
-	buffer->uv.y = uvs[7];
-	buffer->texid = texSlot;
-	buffer++;
-	
-	indexcount += 6;
-
-	//if (tex.ID == 0)
-	//	return;
-	//
-	//f32 r = 1;
-	//f32 g = 1;
-	//f32 b = 1;
-	//f32 a = 1;
-	//
-	//int texSlot = submit_tex(tex);
-	//GLfloat* uvs;
-	//
-	//f32 cosTheta = cos(deg_to_rad(rotation));
-	//f32 sinTheta = sin(deg_to_rad(rotation));
-	//
-	//uvs = DEFAULT_UVS;
-	//if (tex.flip_flag & FLIP_HORIZONTAL && tex.flip_flag & FLIP_VERTICAL)
-	//	uvs = FLIP_BOTH_UVS;
-	//if (tex.flip_flag & FLIP_HORIZONTAL)
-	//	uvs = FLIP_HORIZONTAL_UVS;
-	//if (tex.flip_flag & FLIP_VERTICAL)
-	//	uvs = FLIP_VERTICAL_UVS;
-	//
-	//buffer->pos.x = ( (xPos - origin.x) * cosTheta - (yPos - origin.y) * sinTheta ) + origin.x;
-	//buffer->pos.y = ( (yPos - origin.y) * cosTheta + (xPos - origin.x) * sinTheta ) + origin.y;
-	//buffer->color.x = r;
-	//buffer->color.y = g;
-	//buffer->color.z = b;
-	//buffer->color.w = a;
-	//buffer->uv.x = uvs[0];
-	//buffer->uv.y = uvs[1];
-	//buffer->texid = texSlot;
-	//buffer++;
-	//
-	//buffer->pos.x = ( (xPos - origin.x) * cosTheta - (yPos - origin.y) * sinTheta ) + origin.x;
-	//buffer->pos.y = ( ((yPos + tex.height) - origin.y) * cosTheta + (xPos - origin.x) * sinTheta ) + origin.y;
-	//buffer->color.x = r;
-	//buffer->color.y = g;
-	//buffer->color.z = b;
-	//buffer->color.w = a;
-	//buffer->uv.x = uvs[2];
-	//buffer->uv.y = uvs[3];
-	//buffer->texid = texSlot;
-	//buffer++;
-	//
-	//buffer->pos.x = ( ((xPos + tex.width) - origin.x) * cosTheta - (yPos - origin.y) * sinTheta ) + origin.x;
-	//buffer->pos.y = ( ((yPos + tex.height) - origin.y) * cosTheta + (xPos - origin.x) * sinTheta ) + origin.y;
-	//buffer->color.x = r;
-	//buffer->color.y = g;
-	//buffer->color.z = b;
-	//buffer->color.w = a;
-	//buffer->uv.x = uvs[4];
-	//buffer->uv.y = uvs[5];
-	//buffer->texid = texSlot;
-	//buffer++;
-	//
-	//buffer->pos.x = ( ((xPos + tex.width) - origin.x) * cosTheta - (yPos - origin.y) * sinTheta ) + origin.x;
-	//buffer->pos.y = ( (yPos - origin.y) * cosTheta + (xPos - origin.x) * sinTheta ) + origin.y;
-	//buffer->color.x = r;
-	//buffer->color.y = g;
-	//buffer->color.z = b;
-	//buffer->color.w = a;
-	//buffer->uv.x = uvs[6];
-	//buffer->uv.y = uvs[7];
-	//buffer->texid = texSlot;
-	//buffer++;
-	//
-	//indexcount += 6;
+	push_sprite(&tex, xPos, yPos, tex.width, tex.height, texture_uvs(tex, 0, 0, 1, 1),
+		V4(1, 1, 1, 1), origin, rotation
+	);
 }
 
 void draw_texture_EX(Texture tex, Rect source, Rect dest, f32 r, f32 g, f32 b, f32 a) {
 	if (tex.ID == 0)
 		return;
 
-	r /= 255.0f;
-	g /= 255.0f;
-	b /= 255.0f;
-	a /= 255.0f;
-
-	static GLfloat EX_UVS[8];
-
-	if (tex.flip_flag == 0) {
-		EX_UVS[0] = source.x / tex.width;
-		EX_UVS[1] = source.y / tex.height;
-		EX_UVS[2] = source.x / tex.width;
-		EX_UVS[3] = (source.y + source.height) / tex.height;
-		EX_UVS[4] = (source.x + source.width) / tex.width;
-		EX_UVS[5] = (source.y + source.height) / tex.height;
-		EX_UVS[6] = (source.x + source.width) / tex.width;
-		EX_UVS[7] = source.y / tex.height;
-	}
-	else if (tex.flip_flag & FLIP_HORIZONTAL) {
-		EX_UVS[0] = (source.x + source.width) / tex.width;
-		EX_UVS[1] = source.y / tex.height;
-		EX_UVS[2] = (source.x + source.width) / tex.width;
-		EX_UVS[3] = (source.y + source.height) / tex.height;
-		EX_UVS[4] = source.x / tex.width;
-		EX_UVS[5] = (source.y + source.height) / tex.height;
-		EX_UVS[6] = source.x / tex.width;
-		EX_UVS[7] = source.y / tex.height;
-	}
-	else if (tex.flip_flag & FLIP_VERTICAL) {
-		EX_UVS[0] = source.x / tex.width;
-		EX_UVS[1] = (source.y + source.height) / tex.height;
-		EX_UVS[2] = source.x / tex.width;
-		EX_UVS[3] = source.y / tex.height;
-		EX_UVS[4] = (source.x + source.width) / tex.width;
-		EX_UVS[5] = source.y / tex.height;
-		EX_UVS[6] = (source.x + source.width) / tex.width;
-		EX_UVS[7] = (source.y + source.height) / tex.height;
-	}
-	else if (tex.flip_flag & FLIP_HORIZONTAL && tex.flip_flag & FLIP_VERTICAL) {
-		EX_UVS[0] = (source.x + source.width) / tex.width;
-		EX_UVS[1] = (source.y + source.height) / tex.height;
-		EX_UVS[2] = (source.x + source.width) / tex.width;
-		EX_UVS[3] = source.y / tex.height;
-		EX_UVS[4] = source.x / tex.width;
-		EX_UVS[5] = source.y / tex.height;
-		EX_UVS[6] = source.x / tex.width;
-		EX_UVS[7] = (source.y + source.height) / tex.height;
-	}
-
-	GLfloat* uvs = EX_UVS;
-
-	int texSlot = submit_tex(tex);
-
-	buffer->pos.x = dest.x;
-	buffer->pos.y = dest.y;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = uvs[0];
-	buffer->uv.y = uvs[1];
-	buffer->texid = texSlot;
-	buffer++;
-
-	buffer->pos.x = dest.x;
-	buffer->pos.y = dest.y + dest.height;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = uvs[2];
-	buffer->uv.y = uvs[3];
-	buffer->texid = texSlot;
-	buffer++;
-
-	buffer->pos.x = dest.x + dest.width;
-	buffer->pos.y = dest.y + dest.height;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = uvs[4];
-	buffer->uv.y = uvs[5];
-	buffer->texid = texSlot;
-	buffer++;
-
-	buffer->pos.x = dest.x + dest.width;
-	buffer->pos.y = dest.y;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = uvs[6];
-	buffer->uv.y = uvs[7];
-	buffer->texid = texSlot;
-	buffer++;
-
-	indexcount += 6;
+	vec4 uvs = texture_uvs(tex,
+		source.x / tex.width, source.y / tex.height,
+		(source.x + source.width) / tex.width, (source.y + source.height) / tex.height
+	);
+	push_sprite(&tex, dest.x, dest.y, dest.width, dest.height, uvs,
+		V4(r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f), V2(0, 0), 0
+	);
 }
 
 void draw_texture_EX(Texture tex, Rect source, Rect dest, vec4 color) {
@@ -705,120 +1774,412 @@ void draw_texture_EX(Texture tex, Rect source, Rect dest) {
 	draw_texture_EX(tex, source, dest, 255.0f, 255.0f, 255.0f, 255.0f);
 }
 
+INTERNAL inline
+f32 hull_cross(vec2 o, vec2 a, vec2 b) {
+	return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+INTERNAL
+bool compare_hull_points(vec2 a, vec2 b) {
+	return (a.x < b.x) || (a.x == b.x && a.y < b.y);
+}
+
+//==========================================================================================
+//Description: Finds the point where the edges either side of edge i of a convex polygon 
+//	meet when extended past it, which is where the polygon gets its new corner if edge i
+//	is collapsed.
+//
+//Comments: Returns the area the collapse adds, or a negative value if the edges do not meet
+//		on that side of the polygon or meet outside the bounds.
+//==========================================================================================
+INTERNAL
+f32 collapse_edge(const std::vector<vec2>& hull, u32 i, f32 width, f32 height, vec2* corner) {
+	u32 n = hull.size();
+	vec2 prev = hull[(i + n - 1) % n];
+	vec2 a = hull[i];
+	vec2 b = hull[(i + 1) % n];
+	vec2 next = hull[(i + 2) % n];
+
+	vec2 d1 = V2(a.x - prev.x, a.y - prev.y);
+	vec2 d2 = V2(b.x - next.x, b.y - next.y);
+	vec2 e = V2(b.x - a.x, b.y - a.y);
+	f32 denom = d1.x * d2.y - d1.y * d2.x;
+	if (fabs(denom) < 0.0001f)
+		return -1;
+
+	f32 t = (e.x * d2.y - e.y * d2.x) / denom;
+	f32 u = (e.x * d1.y - e.y * d1.x) / denom;
+	if (t <= 0 || u <= 0)
+		return -1;
+
+	*corner = V2(a.x + d1.x * t, a.y + d1.y * t);
+	if (corner->x < -0.001f || corner->y < -0.001f || corner->x > width + 0.001f || corner->y > height + 0.001f)
+		return -1;
+	return fabs(hull_cross(a, *corner, b)) * 0.5f;
+}
+
+SpriteMesh create_sprite_mesh(const unsigned char* pixels, u32 width, u32 height, u8 threshold) {
+	SpriteMesh mesh = {};
+	if (pixels == NULL || width == 0 || height == 0)
+		return mesh;
+
+	//the corners of the first and last kept pixel of every row are enough to hull them all
+	std::vector<vec2> points;
+	for (u32 y = 0; y < height; ++y) {
+		const unsigned char* row = pixels + (size_t)y * width * 4;
+		i32 minx = -1;
+		i32 maxx = -1;
+		for (u32 x = 0; x < width; ++x) {
+			if (row[x * 4 + 3] > threshold) {
+				if (minx < 0)
+					minx = x;
+				maxx = x;
+			}
+		}
+		if (minx < 0)
+			continue;
+		points.push_back(V2(minx, y));
+		points.push_back(V2(minx, y + 1));
+		points.push_back(V2(maxx + 1, y));
+		points.push_back(V2(maxx + 1, y + 1));
+	}
+	if (points.size() == 0)
+		return mesh;
+
+	//monotone chain convex hull
+	std::sort(points.begin(), points.end(), compare_hull_points);
+	std::vector<vec2> hull(points.size() * 2);
+	u32 k = 0;
+	for (u32 i = 0; i < points.size(); ++i) {
+		while (k >= 2 && hull_cross(hull[k - 2], hull[k - 1], points[i]) <= 0)
+			k--;
+		hull[k++] = points[i];
+	}
+	for (i32 i = (i32)points.size() - 2, lower = k + 1; i >= 0; --i) {
+		while (k >= (u32)lower && hull_cross(hull[k - 2], hull[k - 1], points[i]) <= 0)
+			k--;
+		hull[k++] = points[i];
+	}
+	hull.resize(k - 1);
+
+	while (hull.size() > SPRITE_MESH_MAX_POINTS) {
+		f32 best = -1;
+		u32 bestedge = 0;
+		vec2 bestcorner = V2(0, 0);
+		for (u32 i = 0; i < hull.size(); ++i) {
+			vec2 corner;
+			f32 added = collapse_edge(hull, i, width, height, &corner);
+			if (added >= 0 && (best < 0 || added < best)) {
+				best = added;
+				bestedge = i;
+				bestcorner = corner;
+			}
+		}
+		if (best < 0)
+			return mesh;
+
+		u32 second = (bestedge + 1) % hull.size();
+		hull[bestedge] = bestcorner;
+		hull.erase(hull.begin() + second);
+	}
+
+	//a polygon covering nearly the whole texture saves less than its extra vertices cost
+	f32 area = 0;
+	for (u32 i = 0; i < hull.size(); ++i)
+		area += hull_cross(V2(0, 0), hull[i], hull[(i + 1) % hull.size()]);
+	if (fabs(area) * 0.5f > width * height * 0.9f)
+		return mesh;
+
+	for (u32 i = 0; i < hull.size(); ++i) {
+		f32 x = hull[i].x / width;
+		f32 y = hull[i].y / height;
+		clamp(x, 0.0f, 1.0f);
+		clamp(y, 0.0f, 1.0f);
+		mesh.points[i] = V2(x, y);
+	}
+	mesh.count = hull.size();
+	return mesh;
+}
+
+SpriteMesh create_sprite_mesh(Texture tex, u8 threshold) {
+	SpriteMesh mesh = {};
+	if (tex.ID == 0 || (tex.target != 0 && tex.target != GL_TEXTURE_2D)) {
+		BMT_LOG(WARNING, "Sprite meshes can only be read back from 2D textures");
+		return mesh;
+	}
+
+	GLint width, height;
+	glBindTexture(GL_TEXTURE_2D, tex.ID);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	std::vector<unsigned char> pixels((size_t)width * height * 4);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (tex.region.width == 0)
+		return create_sprite_mesh(&pixels[0], width, height, threshold);
+
+	//a texture from an atlas only hulls its own region of the page
+	u32 left = tex.region.x * width + 0.5f;
+	u32 top = tex.region.y * height + 0.5f;
+	u32 w = tex.region.width * width + 0.5f;
+	u32 h = tex.region.height * height + 0.5f;
+	if (left + w > (u32)width || top + h > (u32)height || w == 0 || h == 0)
+		return mesh;
+	std::vector<unsigned char> region((size_t)w * h * 4);
+	for (u32 y = 0; y < h; ++y)
+		memcpy(&region[(size_t)y * w * 4], &pixels[((size_t)(top + y) * width + left) * 4], w * 4);
+	return create_sprite_mesh(&region[0], w, h, threshold);
+}
+
+void draw_texture_mesh(Texture tex, const SpriteMesh& mesh, i32 xPos, i32 yPos) {
+	if (tex.ID == 0)
+		return;
+	push_sprite(&tex, xPos, yPos, tex.width, tex.height, texture_uvs(tex, 0, 0, 1, 1),
+		V4(1, 1, 1, 1), V2(0, 0), 0, 0, &mesh
+	);
+}
+
+void draw_texture_mesh(Texture tex, const SpriteMesh& mesh, Rect dest, f32 rotation, vec4 color) {
+	if (tex.ID == 0)
+		return;
+	vec2 origin = V2(dest.x + dest.width / 2, dest.y + dest.height / 2);
+	push_sprite(&tex, dest.x, dest.y, dest.width, dest.height, texture_uvs(tex, 0, 0, 1, 1),
+		V4(color.x / 255.0f, color.y / 255.0f, color.z / 255.0f, color.w / 255.0f), origin, rotation, 0, &mesh
+	);
+}
+
+#if defined(BMT_SSE2)
+//==========================================================================================
+//Description: Approximate sine of four angles in -PI to PI. A parabola fit with one 
+//	refinement step, the error stays below 0.001.
+//==========================================================================================
+INTERNAL inline
+__m128 sin_approx_ps(__m128 x) {
+	const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	const __m128 b = _mm_set1_ps(4.0f / PI);
+	const __m128 c = _mm_set1_ps(-4.0f / (PI * PI));
+	const __m128 p = _mm_set1_ps(0.225f);
+
+	__m128 y = _mm_add_ps(_mm_mul_ps(b, x), _mm_mul_ps(_mm_mul_ps(c, x), _mm_and_ps(x, absmask)));
+	return _mm_add_ps(_mm_mul_ps(p, _mm_sub_ps(_mm_mul_ps(y, _mm_and_ps(y, absmask)), y)), y);
+}
+
+//==========================================================================================
+//Description: Wraps four angles (in radians) into -PI to PI.
+//==========================================================================================
+INTERNAL inline
+__m128 wrap_angle_ps(__m128 x) {
+	const __m128 twopi = _mm_set1_ps(2.0f * PI);
+	const __m128 invtwopi = _mm_set1_ps(1.0f / (2.0f * PI));
+	__m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(x, invtwopi)));
+	return _mm_sub_ps(x, _mm_mul_ps(turns, twopi));
+}
+
+INTERNAL inline
+void sincos_approx_ps(__m128 x, __m128* sine, __m128* cosine) {
+	const __m128 pi = _mm_set1_ps(PI);
+	const __m128 halfpi = _mm_set1_ps(PI / 2.0f);
+	const __m128 twopi = _mm_set1_ps(2.0f * PI);
+
+	x = wrap_angle_ps(x);
+	*sine = sin_approx_ps(x);
+	//cos(x) = sin(x + PI/2), wrapped back into range where it went past PI
+	__m128 shifted = _mm_add_ps(x, halfpi);
+	shifted = _mm_sub_ps(shifted, _mm_and_ps(_mm_cmpgt_ps(shifted, pi), twopi));
+	*cosine = sin_approx_ps(shifted);
+}
+
+//==========================================================================================
+//Description: Copies one finished sprite into the mapped buffer with non-temporal stores,
+//	which skip the cache since the CPU never reads the buffer back.
+//==========================================================================================
+INTERNAL inline
+void stream_sprite(VertexData* dest, const VertexData* quad) {
+	static_assert(BATCH_SPRITE_SIZE % 16 == 0, "a sprite must be a whole number of SSE registers");
+	if (((uintptr_t)dest & 15) != 0) {
+		memcpy(dest, quad, BATCH_SPRITE_SIZE);
+		return;
+	}
+	const f32* src = (const f32*)quad;
+	f32* dst = (f32*)dest;
+	for (u32 i = 0; i < BATCH_SPRITE_SIZE / sizeof(f32); i += 4)
+		_mm_stream_ps(dst + i, _mm_load_ps(src + i));
+}
+
+INTERNAL
+void draw_sprites_sse(const SpriteInstance* sprites, u32 count) {
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 torad = _mm_set1_ps(PI / 180.0f);
+
+	const Texture* lasttex = NULL;
+	f32 texSlot = 0;
+	u8 depth = get_command_list()->layer;
+	u8 blend = get_command_list()->blend;
+	vec4 uvs = V4(0, 0, 1, 1);
+	u8 texblend = blend;
+
+	for (u32 start = 0; start < count; start += 4) {
+		u32 group = (count - start < 4) ? count - start : 4;
+		const SpriteInstance* s = sprites + start;
+
+		//gather the group into one register per field, unused lanes are copies of the first
+		const SpriteInstance* l[4];
+		for (u32 i = 0; i < 4; ++i)
+			l[i] = (i < group) ? &s[i] : &s[0];
+		__m128 w = _mm_setr_ps(l[0]->width, l[1]->width, l[2]->width, l[3]->width);
+		__m128 h = _mm_setr_ps(l[0]->height, l[1]->height, l[2]->height, l[3]->height);
+		__m128 hw = _mm_mul_ps(w, half);
+		__m128 hh = _mm_mul_ps(h, half);
+		__m128 cx = _mm_add_ps(_mm_setr_ps(l[0]->x, l[1]->x, l[2]->x, l[3]->x), hw);
+		__m128 cy = _mm_add_ps(_mm_setr_ps(l[0]->y, l[1]->y, l[2]->y, l[3]->y), hh);
+		__m128 rad = _mm_mul_ps(_mm_setr_ps(l[0]->rotation, l[1]->rotation, l[2]->rotation, l[3]->rotation), torad);
+
+		__m128 sine, cosine;
+		sincos_approx_ps(rad, &sine, &cosine);
+
+		//corners in write_quad order: top left, bottom left, bottom right, top right
+		__m128 nhw = _mm_sub_ps(_mm_setzero_ps(), hw);
+		__m128 nhh = _mm_sub_ps(_mm_setzero_ps(), hh);
+		__m128 dxs[4] = { nhw, nhw, hw, hw };
+		__m128 dys[4] = { nhh, hh, hh, nhh };
+		alignas(16) f32 xs[4][4];
+		alignas(16) f32 ys[4][4];
+		for (u32 c = 0; c < 4; ++c) {
+			__m128 x = _mm_add_ps(cx, _mm_sub_ps(_mm_mul_ps(cosine, dxs[c]), _mm_mul_ps(sine, dys[c])));
+			__m128 y = _mm_add_ps(cy, _mm_add_ps(_mm_mul_ps(sine, dxs[c]), _mm_mul_ps(cosine, dys[c])));
+			_mm_store_ps(xs[c], x);
+			_mm_store_ps(ys[c], y);
+		}
+
+		for (u32 i = 0; i < group; ++i) {
+			const SpriteInstance& sprite = s[i];
+			if (culling && sprite_culled(sprite.x, sprite.y, sprite.width, sprite.height, 
+				V2(sprite.x + sprite.width / 2.0f, sprite.y + sprite.height / 2.0f), sprite.rotation)) {
+				frame_stats.culled++;
+				continue;
+			}
+			frame_stats.emitted++;
+
+			if (!batch_has_room(4, 6)) {
+				flush_batch(FLUSH_CAPACITY);
+				begin_batch();
+				lasttex = NULL;
+			}
+			//the slot is only looked up again when the texture changes or the batch was flushed
+			if (sprite.tex != lasttex || (lasttex == NULL && texSlot != 0)) {
+				lasttex = sprite.tex;
+				texSlot = 0;
+				uvs = V4(0, 0, 1, 1);
+				texblend = blend;
+				if (sprite.tex != NULL) {
+					texSlot = (f32)submit_tex(*sprite.tex);
+					uvs = texture_uvs(*sprite.tex, 0, 0, 1, 1);
+					if (sprite.tex->premultiplied)
+						texblend |= BLEND_PREMULTIPLIED_TEXTURE;
+				}
+			}
+
+			vec4 color = V4(sprite.color.x / 255.0f, sprite.color.y / 255.0f, sprite.color.z / 255.0f, sprite.color.w / 255.0f);
+			alignas(16) VertexData quad[4];
+			write_vertex(&quad[0], V2(xs[0][i], ys[0][i]), color, uvs.x, uvs.y, texSlot, depth, texblend);
+			write_vertex(&quad[1], V2(xs[1][i], ys[1][i]), color, uvs.x, uvs.w, texSlot, depth, texblend);
+			write_vertex(&quad[2], V2(xs[2][i], ys[2][i]), color, uvs.z, uvs.w, texSlot, depth, texblend);
+			write_vertex(&quad[3], V2(xs[3][i], ys[3][i]), color, uvs.z, uvs.y, texSlot, depth, texblend);
+			stream_sprite(buffer, quad);
+			add_quad_indices();
+			buffer += 4;
+		}
+	}
+	//streaming stores are weakly ordered, they must land before the buffer is drawn
+	_mm_sfence();
+}
+#endif
+
+void draw_sprites(const SpriteInstance* sprites, u32 count) {
+#if defined(BMT_SSE2)
+	if (!batch_sorted && !batch_instanced && std::this_thread::get_id() == gl_thread && get_command_list()->clips.empty()) {
+		f64 start = begin_emit_timer();
+		draw_sprites_sse(sprites, count);
+		end_emit_timer(start);
+		return;
+	}
+#endif
+	for (u32 i = 0; i < count; ++i) {
+		const SpriteInstance& sprite = sprites[i];
+		vec4 uvs = (sprite.tex != NULL) ? texture_uvs(*sprite.tex, 0, 0, 1, 1) : V4(0, 0, 1, 1);
+		push_sprite(sprite.tex, sprite.x, sprite.y, sprite.width, sprite.height, uvs,
+			V4(sprite.color.x / 255.0f, sprite.color.y / 255.0f, sprite.color.z / 255.0f, sprite.color.w / 255.0f),
+			V2(sprite.x + sprite.width / 2.0f, sprite.y + sprite.height / 2.0f), sprite.rotation
+		);
+	}
+}
+
 void draw_framebuffer(Framebuffer buffer, i32 xPos, i32 yPos) {
 	draw_texture(buffer.texture, xPos, yPos);
 }
 
 void draw_rectangle(i32 x, i32 y, i32 width, i32 height, f32 r, f32 g, f32 b, f32 a) {
-	r /= 255.0f;
-	g /= 255.0f;
-	b /= 255.0f;
-	a /= 255.0f;
-
-	buffer->pos.x = x;
-	buffer->pos.y = y;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = 0.0f;
-	buffer->uv.y = 0.0f;
-	buffer->texid = 0;
-	buffer++;
-
-	buffer->pos.x = x;
-	buffer->pos.y = y + height;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = 0.0f;
-	buffer->uv.y = 1.0f;
-	buffer->texid = 0;
-	buffer++;
-
-	buffer->pos.x = x + width;
-	buffer->pos.y = y + height;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = 1.0f;
-	buffer->uv.y = 1.0f;
-	buffer->texid = 0;
-	buffer++;
-
-	buffer->pos.x = x + width;
-	buffer->pos.y = y;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = 1.0f;
-	buffer->uv.y = 0.0f;
-	buffer->texid = 0;
-	buffer++;
-
-	indexcount += 6;
+	push_sprite(NULL, x, y, width, height, V4(0, 0, 1, 1),
+		V4(r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f), V2(0, 0), 0
+	);
 }
 
 void draw_rectangle(i32 x, i32 y, i32 width, i32 height, vec4 color) {
-	f32 r = color.x / 255.0f;
-	f32 g = color.y / 255.0f;
-	f32 b = color.z / 255.0f;
-	f32 a = color.w / 255.0f;
-
-	buffer->pos.x = x;
-	buffer->pos.y = y;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = 0.0f;
-	buffer->uv.y = 0.0f;
-	buffer->texid = 0;
-	buffer++;
-
-	buffer->pos.x = x;
-	buffer->pos.y = y + height;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = 0.0f;
-	buffer->uv.y = 1.0f;
-	buffer->texid = 0;
-	buffer++;
-
-	buffer->pos.x = x + width;
-	buffer->pos.y = y + height;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = 1.0f;
-	buffer->uv.y = 1.0f;
-	buffer->texid = 0;
-	buffer++;
-
-	buffer->pos.x = x + width;
-	buffer->pos.y = y;
-	buffer->color.x = r;
-	buffer->color.y = g;
-	buffer->color.z = b;
-	buffer->color.w = a;
-	buffer->uv.x = 1.0f;
-	buffer->uv.y = 0.0f;
-	buffer->texid = 0;
-	buffer++;
+	draw_rectangle(x, y, width, height, color.x, color.y, color.z, color.w);
+}
 
-	indexcount += 6;
+//==========================================================================================
+//Description: Draws an SDF shape as a single untextured quad.
+//
+//Parameters: 
+//		-The kind of shape (SHAPE_ELLIPSE, SHAPE_RING, SHAPE_ROUNDED_RECT)
+//		-A parameter from 0 to 1: ring thickness or corner radius, relative to the shape's
+//			smaller half size
+//		-The area the shape fills, a color (RGBA, 0 to 255) and a degree to rotate by
+//==========================================================================================
+INTERNAL
+void push_shape(u32 kind, f32 param, f32 x, f32 y, f32 width, f32 height, vec4 color, f32 rotation) {
+	clamp(param, 0.0f, 1.0f);
+	//one pixel of margin on every side leaves room for the antialiased edge
+	push_sprite(NULL, x - 1, y - 1, width + 2, height + 2, V4(0, 0, 1, 1),
+		V4(color.x / 255.0f, color.y / 255.0f, color.z / 255.0f, color.w / 255.0f),
+		V2(x + width / 2.0f, y + height / 2.0f), rotation, kind + param * 0.99f
+	);
+}
+
+void draw_circle(f32 x, f32 y, f32 radius, vec4 color) {
+	push_shape(SHAPE_ELLIPSE, 0, x - radius, y - radius, radius * 2, radius * 2, color, 0);
+}
+
+void draw_ring(f32 x, f32 y, f32 radius, f32 thickness, vec4 color) {
+	if (radius <= 0)
+		return;
+	push_shape(SHAPE_RING, thickness / radius, x - radius, y - radius, radius * 2, radius * 2, color, 0);
+}
+
+void draw_rounded_rectangle(i32 x, i32 y, i32 width, i32 height, f32 radius, vec4 color) {
+	f32 halfsize = ((width < height) ? width : height) / 2.0f;
+	if (halfsize <= 0)
+		return;
+	push_shape(SHAPE_ROUNDED_RECT, radius / halfsize, x, y, width, height, color, 0);
+}
+
+void draw_line(f32 x1, f32 y1, f32 x2, f32 y2, f32 thickness, vec4 color) {
+	f32 dx = x2 - x1;
+	f32 dy = y2 - y1;
+	f32 length = sqrt(dx * dx + dy * dy);
+	f32 centerx = (x1 + x2) / 2.0f;
+	f32 centery = (y1 + y2) / 2.0f;
+	//a fully rounded rectangle along the line is a capsule, which gives round caps
+	push_shape(SHAPE_ROUNDED_RECT, 1, centerx - (length + thickness) / 2.0f, centery - thickness / 2.0f,
+		length + thickness, thickness, color, rad_to_deg(atan2(dy, dx))
+	);
 }
 
 void draw_text(Font& font, const char* str, i32 xPos, i32 yPos, f32 r, f32 g, f32 b) {
-	r /= 255;
-	g /= 255;
-	b /= 255;
+	vec4 color = V4(r / 255.0f, g / 255.0f, b / 255.0f, 1);
 
 	u32 len = strlen(str);
 	for (u32 i = 0; i < len; ++i) {
@@ -829,158 +2190,443 @@ void draw_text(Font& font, const char* str, i32 xPos, i32 yPos, f32 r, f32 g, f3
 		int x = xPos + c->bearing.x;
 		int y = yPos + yOffset;
 
-		Texture tex = font.characters[str[i]]->texture;
-		int texSlot = submit_tex(tex);
-		GLfloat* uvs;
-		uvs = DEFAULT_UVS;
-
-		buffer->pos.x = x;
-		buffer->pos.y = y;
-		buffer->color.x = r;
-		buffer->color.y = g;
-		buffer->color.z = b;
-		buffer->color.w = 1;
-		buffer->uv.x = uvs[0];
-		buffer->uv.y = uvs[1];
-		buffer->texid = texSlot;
-		buffer++;
-
-		buffer->pos.x = x;
-		buffer->pos.y = y + tex.height;
-		buffer->color.x = r;
-		buffer->color.y = g;
-		buffer->color.z = b;
-		buffer->color.w = 1;
-		buffer->uv.x = uvs[2];
-		buffer->uv.y = uvs[3];
-		buffer->texid = texSlot;
-		buffer++;
-
-		buffer->pos.x = x + tex.width;
-		buffer->pos.y = y + tex.height;
-		buffer->color.x = r;
-		buffer->color.y = g;
-		buffer->color.z = b;
-		buffer->color.w = 1;
-		buffer->uv.x = uvs[4];
-		buffer->uv.y = uvs[5];
-		buffer->texid = texSlot;
-		buffer++;
-
-		buffer->pos.x = x + tex.width;
-		buffer->pos.y = y;
-		buffer->color.x = r;
-		buffer->color.y = g;
-		buffer->color.z = b;
-		buffer->color.w = 1;
-		buffer->uv.x = uvs[6];
-		buffer->uv.y = uvs[7];
-		buffer->texid = texSlot;
-		buffer++;
+		Texture* tex = &c->texture;
+		push_sprite(tex, x, y, tex->width, tex->height, V4(0, 0, 1, 1), color, V2(0, 0), 0);
 
-		indexcount += 6;
-		xPos += (font.characters[str[i]]->advance >> 6);
+		xPos += (c->advance >> 6);
 	}
 }
 
 void draw_text(Font& font, std::string str, i32 xPos, i32 yPos, f32 r, f32 g, f32 b) {
-	r /= 255;
-	g /= 255;
-	b /= 255;
+	draw_text(font, str.c_str(), xPos, yPos, r, g, b);
+}
 
-	for (u16 i = 0; i < str.size(); ++i) {
-		Character* c = font.characters[str[i]];
-		int yOffset = (font.characters['T']->bearing.y - c->bearing.y) + 1;
-		if (yOffset < 0) yOffset = 0;
+void end2D() {
+	if (batch_sorted) {
+		emit_sorted_commands();
+		batch_sorted = false;
+	}
 
-		int x = xPos + c->bearing.x;
-		int y = yPos + yOffset;
+	u16 boundcount = texcount;
+	flush_batch(FLUSH_EXPLICIT);
+	if (batch_depth) {
+		glDepthMask(GL_TRUE);
+		glDepthFunc(saved_depth_func);
+		batch_depth = false;
+	}
+
+	for (u16 i = 0; i < boundcount; ++i)
+		unbind_texture(i);
+	if (batch_arrayed) {
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	}
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-		Texture tex = font.characters[str[i]]->texture;
-		int texSlot = submit_tex(tex);
-		GLfloat* uvs;
-		uvs = DEFAULT_UVS;
-
-		buffer->pos.x = x;
-		buffer->pos.y = y;
-		buffer->color.x = r;
-		buffer->color.y = g;
-		buffer->color.z = b;
-		buffer->color.w = 1;
-		buffer->uv.x = uvs[0];
-		buffer->uv.y = uvs[1];
-		buffer->texid = texSlot;
-		buffer++;
-
-		buffer->pos.x = x;
-		buffer->pos.y = y + tex.height;
-		buffer->color.x = r;
-		buffer->color.y = g;
-		buffer->color.z = b;
-		buffer->color.w = 1;
-		buffer->uv.x = uvs[2];
-		buffer->uv.y = uvs[3];
-		buffer->texid = texSlot;
-		buffer++;
-
-		buffer->pos.x = x + tex.width;
-		buffer->pos.y = y + tex.height;
-		buffer->color.x = r;
-		buffer->color.y = g;
-		buffer->color.z = b;
-		buffer->color.w = 1;
-		buffer->uv.x = uvs[4];
-		buffer->uv.y = uvs[5];
-		buffer->texid = texSlot;
-		buffer++;
-
-		buffer->pos.x = x + tex.width;
-		buffer->pos.y = y;
-		buffer->color.x = r;
-		buffer->color.y = g;
-		buffer->color.z = b;
-		buffer->color.w = 1;
-		buffer->uv.x = uvs[6];
-		buffer->uv.y = uvs[7];
-		buffer->texid = texSlot;
-		buffer++;
+	batch_open = false;
+	stop_shader();
+}
 
-		indexcount += 6;
-		xPos += (font.characters[str[i]]->advance >> 6);
+//dirty sprites closer together than this are uploaded as one range
+#define SPRITE_LAYER_MERGE_GAP 32
+
+INTERNAL
+void resize_sprite_layer(SpriteLayer& layer, u32 capacity) {
+	layer.capacity = capacity;
+	layer.vertices.resize(capacity * 4);
+	layer.dirty.resize(capacity, 0);
+	layer.alive.resize(capacity, 0);
+
+	glBindVertexArray(layer.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, layer.vbo);
+	glBufferData(GL_ARRAY_BUFFER, capacity * BATCH_SPRITE_SIZE, NULL, GL_DYNAMIC_DRAW);
+
+	GLuint* indices = (GLuint*)malloc(capacity * 6 * sizeof(GLuint));
+	fill_quad_indices(indices, capacity);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, layer.ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, capacity * 6 * sizeof(GLuint), indices, GL_STATIC_DRAW);
+	free(indices);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	//the new buffer store is empty, everything has to be uploaded again
+	layer.dirtylist.clear();
+	for (u32 i = 0; i < layer.count; ++i) {
+		layer.dirty[i] = 1;
+		layer.dirtylist.push_back(i);
 	}
 }
 
-void end2D() {
-	glUnmapBuffer(GL_ARRAY_BUFFER);
+INTERNAL
+void mark_layer_sprite(SpriteLayer& layer, u32 handle) {
+	if (layer.dirty[handle])
+		return;
+	layer.dirty[handle] = 1;
+	layer.dirtylist.push_back(handle);
+}
+
+INTERNAL
+f32 layer_texture_slot(SpriteLayer& layer, Texture tex) {
+	for (u32 i = 0; i < layer.texcount; ++i) {
+		if (layer.textures[i] == tex.ID)
+			return i + 1;
+	}
+	if (layer.texcount >= BATCH_MAX_TEXTURES) {
+		BMT_LOG(WARNING, "Sprite layer already uses %d textures, texture #%d is drawn untextured", 
+			BATCH_MAX_TEXTURES, tex.ID
+		);
+		return 0;
+	}
+	layer.textures[layer.texcount++] = tex.ID;
+	return layer.texcount;
+}
+
+INTERNAL
+void write_layer_sprite(SpriteLayer& layer, u32 handle, Texture tex, Rect source, Rect dest, vec4 color, f32 rotation) {
+	vec4 uvs = texture_uvs(tex, 
+		source.x / tex.width, source.y / tex.height,
+		(source.x + source.width) / tex.width, (source.y + source.height) / tex.height
+	);
+	vec2 origin = V2(dest.x + dest.width / 2.0f, dest.y + dest.height / 2.0f);
+	f32 texSlot = (tex.ID != 0) ? layer_texture_slot(layer, tex) : 0;
+	write_quad(&layer.vertices[handle * 4], dest.x, dest.y, dest.width, dest.height, uvs,
+		V4(color.x / 255.0f, color.y / 255.0f, color.z / 255.0f, color.w / 255.0f), origin, rotation, texSlot, 0,
+		tex.premultiplied ? BLEND_PREMULTIPLIED_TEXTURE : BLEND_ALPHA
+	);
+	mark_layer_sprite(layer, handle);
+}
+
+SpriteLayer create_sprite_layer(u32 capacity) {
+	SpriteLayer layer;
+	layer.count = 0;
+	layer.texcount = 0;
+	if (capacity == 0)
+		capacity = 1;
+
+	glGenVertexArrays(1, &layer.vao);
+	glGenBuffers(1, &layer.vbo);
+	glGenBuffers(1, &layer.ebo);
+	resize_sprite_layer(layer, capacity);
+
+	//the layer owns its vao, so the attribute layout is only set once
+	glBindVertexArray(layer.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, layer.vbo);
+	set_vertex_attribs(0);
+	for (u32 i = 0; i < 5; ++i)
+		glEnableVertexAttribArray(i);
+	glBindVertexArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	for (u16 i = 0; i < texcount; ++i) {
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, textures[i]);
-		upload_int(shader, locations[i], i);
+	return layer;
+}
+
+u32 add_layer_sprite(SpriteLayer& layer, Texture tex, Rect source, Rect dest, vec4 color, f32 rotation) {
+	u32 handle;
+	if (!layer.freelist.empty()) {
+		handle = layer.freelist.back();
+		layer.freelist.pop_back();
+	}
+	else {
+		if (layer.count >= layer.capacity)
+			resize_sprite_layer(layer, layer.capacity * 2);
+		handle = layer.count++;
 	}
+	layer.alive[handle] = 1;
+	write_layer_sprite(layer, handle, tex, source, dest, color, rotation);
+	return handle;
+}
 
-	glBindVertexArray(vao);
-	glEnableVertexAttribArray(0); //position
-	glEnableVertexAttribArray(1); //color
-	glEnableVertexAttribArray(2); //texture coordinates
-	glEnableVertexAttribArray(3); //texture ID
+u32 add_layer_sprite(SpriteLayer& layer, Texture tex, Rect dest, vec4 color, f32 rotation) {
+	return add_layer_sprite(layer, tex, rect(0, 0, tex.width, tex.height), dest, color, rotation);
+}
+
+void update_layer_sprite(SpriteLayer& layer, u32 handle, Texture tex, Rect source, Rect dest, vec4 color, f32 rotation) {
+	if (handle >= layer.count || !layer.alive[handle]) {
+		BMT_LOG(WARNING, "Sprite layer has no sprite with handle %d", handle);
+		return;
+	}
+	write_layer_sprite(layer, handle, tex, source, dest, color, rotation);
+}
+
+void update_layer_sprite(SpriteLayer& layer, u32 handle, Texture tex, Rect dest, vec4 color, f32 rotation) {
+	update_layer_sprite(layer, handle, tex, rect(0, 0, tex.width, tex.height), dest, color, rotation);
+}
+
+void remove_layer_sprite(SpriteLayer& layer, u32 handle) {
+	if (handle >= layer.count || !layer.alive[handle]) {
+		BMT_LOG(WARNING, "Sprite layer has no sprite with handle %d", handle);
+		return;
+	}
+	layer.alive[handle] = 0;
+	//a quad with all four corners in one place covers no pixels, so the slot just stays in the draw
+	for (u32 i = 0; i < 4; ++i)
+		write_vertex(&layer.vertices[handle * 4 + i], V2(0, 0), V4(0, 0, 0, 0), 0, 0, 0, 0, 0);
+	mark_layer_sprite(layer, handle);
+	layer.freelist.push_back(handle);
+}
+
+void draw_sprite_layer(SpriteLayer& layer) {
+	if (batch_instanced || batch_arrayed) {
+		BMT_LOG(WARNING, "Sprite layers can only be drawn with the default 2D shader pipeline");
+		return;
+	}
 
-	glDrawElements(GL_TRIANGLES, indexcount, GL_UNSIGNED_SHORT, 0);
+	//whatever was drawn before the layer has to stay underneath it
+	if (batch_sorted)
+		emit_sorted_commands();
+	flush_batch(FLUSH_EXPLICIT);
+
+	glBindBuffer(GL_ARRAY_BUFFER, layer.vbo);
+	if (!layer.dirtylist.empty()) {
+		std::sort(layer.dirtylist.begin(), layer.dirtylist.end());
+		u32 start = layer.dirtylist[0];
+		u32 end = start + 1;
+		for (u32 i = 1; i <= layer.dirtylist.size(); ++i) {
+			if (i < layer.dirtylist.size() && layer.dirtylist[i] - end < SPRITE_LAYER_MERGE_GAP) {
+				end = layer.dirtylist[i] + 1;
+				continue;
+			}
+			glBufferSubData(GL_ARRAY_BUFFER, start * BATCH_SPRITE_SIZE, (end - start) * BATCH_SPRITE_SIZE, &layer.vertices[start * 4]);
+			frame_stats.bytes_uploaded += (end - start) * BATCH_SPRITE_SIZE;
+			if (i < layer.dirtylist.size()) {
+				start = layer.dirtylist[i];
+				end = start + 1;
+			}
+		}
+		for (u32 i = 0; i < layer.dirtylist.size(); ++i)
+			layer.dirty[layer.dirtylist[i]] = 0;
+		layer.dirtylist.clear();
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	glDisableVertexAttribArray(0); //position
-	glDisableVertexAttribArray(1); //color
-	glDisableVertexAttribArray(2); //texture coordinates
-	glDisableVertexAttribArray(3); //textureID
+	bind_batch_textures(shader, layer.textures, layer.texcount);
+	for (u16 i = 0; i < layer.texcount; ++i)
+		count_texture(layer.textures[i]);
+	glBindVertexArray(layer.vao);
+	begin_gpu_timer();
+	glDrawElements(GL_TRIANGLES, layer.count * 6, GL_UNSIGNED_INT, 0);
+	end_gpu_timer();
 	glBindVertexArray(0);
+	frame_stats.drawcalls++;
+	frame_stats.quads += layer.count;
 
-	for (u16 i = 0; i < texcount; ++i)
-		unbind_texture(textures[i]);
+	begin_batch();
+}
 
-	indexcount = 0;
-	texcount = 0;
+void dispose_sprite_layer(SpriteLayer& layer) {
+	glDeleteVertexArrays(1, &layer.vao);
+	glDeleteBuffers(1, &layer.vbo);
+	glDeleteBuffers(1, &layer.ebo);
+	layer.vao = layer.vbo = layer.ebo = 0;
+	layer.vertices.clear();
+	layer.dirty.clear();
+	layer.alive.clear();
+	layer.dirtylist.clear();
+	layer.freelist.clear();
+	layer.count = layer.capacity = 0;
+	layer.texcount = 0;
+}
 
-	stop_shader();
+//==========================================================================================
+//Description: (Re)creates the framebuffer of a render layer at its current size
+//==========================================================================================
+INTERNAL
+void build_render_layer(RenderLayer& layer) {
+	if (layer.buffer.ID != 0)
+		dispose_framebuffer(layer.buffer);
+	layer.buffer = create_framebuffer(layer.width, layer.height, GL_NEAREST, COLORBUFFER);
+	//the projection puts y = 0 at the top, which ends up as the last row of the texture
+	layer.buffer.texture.flip_flag = FLIP_VERTICAL;
+	//2D passes blend alpha as coverage into a transparent target, which leaves the colors
+	//multiplied by it
+	layer.buffer.texture.premultiplied = true;
+	layer.dirty = true;
+}
+
+RenderLayer create_render_layer(u32 width, u32 height, bool invalidate_on_resize) {
+	RenderLayer layer = { 0 };
+	layer.follow_window = width == 0 || height == 0;
+	layer.invalidate_on_resize = invalidate_on_resize;
+	layer.window_width = get_window_width();
+	layer.window_height = get_window_height();
+	layer.width = layer.follow_window ? layer.window_width : width;
+	layer.height = layer.follow_window ? layer.window_height : height;
+	build_render_layer(layer);
+	return layer;
+}
+
+bool begin_render_layer(RenderLayer& layer) {
+	i32 window_width = get_window_width();
+	i32 window_height = get_window_height();
+	if (window_width != layer.window_width || window_height != layer.window_height) {
+		layer.window_width = window_width;
+		layer.window_height = window_height;
+		//a minimized window reports 0, keep the old target until it comes back
+		if (layer.follow_window && window_width > 0 && window_height > 0) {
+			layer.width = window_width;
+			layer.height = window_height;
+			build_render_layer(layer);
+		}
+		if (layer.invalidate_on_resize)
+			layer.dirty = true;
+	}
+	if (!layer.dirty)
+		return false;
+
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &layer.previous_buffer);
+	glGetIntegerv(GL_VIEWPORT, layer.previous_viewport);
+	bind_framebuffer(layer.buffer);
+	glViewport(0, 0, layer.width, layer.height);
+
+	GLfloat clear_color[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+	return true;
+}
+
+void end_render_layer(RenderLayer& layer) {
+	glBindFramebuffer(GL_FRAMEBUFFER, layer.previous_buffer);
+	glViewport(layer.previous_viewport[0], layer.previous_viewport[1], layer.previous_viewport[2], layer.previous_viewport[3]);
+	layer.dirty = false;
+}
+
+void invalidate_render_layer(RenderLayer& layer) {
+	layer.dirty = true;
+}
+
+void draw_render_layer(RenderLayer& layer, i32 xPos, i32 yPos) {
+	if (batch_arrayed) {
+		BMT_LOG(WARNING, "Render layers can not be drawn with the array shader");
+		return;
+	}
+
+	Texture* tex = &layer.buffer.texture;
+	CommandList* list = get_command_list();
+	if (batch_premultiplied) {
+		push_sprite(tex, xPos, yPos, tex->width, tex->height, texture_uvs(*tex, 0, 0, 1, 1), V4(1, 1, 1, 1), V2(0, 0), 0);
+		return;
+	}
+
+	//a shader writing straight alpha needs its own blend function for the layer, so it is
+	//drawn on its own and whatever was drawn before it has to stay underneath
+	if (batch_sorted)
+		emit_sorted_commands();
+	flush_batch(FLUSH_EXPLICIT);
+	begin_batch();
+
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	frame_stats.emitted++;
+	emit_sprite(tex, xPos, yPos, tex->width, tex->height, texture_uvs(*tex, 0, 0, 1, 1), V4(1, 1, 1, 1), V2(0, 0), 0, 0, list->layer, BLEND_ALPHA, NULL, list->clips.empty() ? NULL : &list->clips.back());
+	flush_batch(FLUSH_EXPLICIT);
+	glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	begin_batch();
+}
+
+void dispose_render_layer(RenderLayer& layer) {
+	if (layer.buffer.ID != 0)
+		dispose_framebuffer(layer.buffer);
+	layer.buffer.ID = 0;
+	layer.width = layer.height = 0;
+}
+
+DynamicResolution create_dynamic_resolution(f32 target_fps, f32 min_scale, f32 max_scale) {
+	DynamicResolution res = { 0 };
+	if (target_fps < 1)
+		target_fps = 60;
+	res.target_time = 1.0 / target_fps;
+	res.smoothed_time = res.target_time;
+	//the target is only as large as the window, it can not render above native resolution
+	res.max_scale = max_scale;
+	clamp(res.max_scale, 0.1f, 1.0f);
+	res.min_scale = min_scale;
+	clamp(res.min_scale, 0.1f, res.max_scale);
+	res.scale = res.max_scale;
+	return res;
+}
+
+//==========================================================================================
+//Description: Moves the scale of a dynamic resolution target towards the one that renders
+//	a frame in the target time
+//==========================================================================================
+INTERNAL
+void update_resolution_scale(DynamicResolution& res) {
+	f64 frame = get_frame_time();
+	if (frame <= 0)
+		return;
+	//smoothed, so a single slow frame (loading, a hitch) barely moves the scale
+	res.smoothed_time += (frame - res.smoothed_time) * 0.1;
+
+	f32 scale = res.scale;
+	if (res.smoothed_time > res.target_time * 1.05) {
+		f32 step = (f32)sqrt(res.target_time / res.smoothed_time);
+		scale *= (step < 0.9f) ? 0.9f : step;
+		res.stable_frames = 0;
+	}
+	else if (res.smoothed_time < res.target_time * 0.85) {
+		f32 step = (f32)sqrt(res.target_time / res.smoothed_time);
+		scale *= (step > 1.05f) ? 1.05f : step;
+		res.stable_frames = 0;
+	}
+	else if (++res.stable_frames >= DYNAMIC_RESOLUTION_PROBE_FRAMES) {
+		scale += 0.02f;
+		res.stable_frames = 0;
+	}
+	clamp(scale, res.min_scale, res.max_scale);
+	res.scale = scale;
+}
+
+void begin_dynamic_resolution(DynamicResolution& res) {
+	i32 window_width = get_window_width();
+	i32 window_height = get_window_height();
+	//a minimized window reports 0, keep the old target until it comes back
+	if (window_width > 0 && window_height > 0 && ((u32)window_width != res.width || (u32)window_height != res.height)) {
+		if (res.buffer.ID != 0)
+			dispose_framebuffer(res.buffer);
+		res.width = window_width;
+		res.height = window_height;
+		res.buffer = create_framebuffer(res.width, res.height, GL_LINEAR, COLORBUFFER);
+		res.buffer.texture.flip_flag = FLIP_VERTICAL;
+		res.buffer.texture.premultiplied = true;
+	}
+	update_resolution_scale(res);
+
+	//snapped to 8 pixels, so small changes of the scale do not make the scene shimmer
+	res.scaled_width = ((u32)(res.width * res.scale) + 7) & ~7u;
+	res.scaled_height = ((u32)(res.height * res.scale) + 7) & ~7u;
+	if (res.scaled_width > res.width)
+		res.scaled_width = res.width;
+	if (res.scaled_height > res.height)
+		res.scaled_height = res.height;
+
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &res.previous_buffer);
+	glGetIntegerv(GL_VIEWPORT, res.previous_viewport);
+	bind_framebuffer(res.buffer);
+	glViewport(0, 0, res.scaled_width, res.scaled_height);
+	glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void end_dynamic_resolution(DynamicResolution& res) {
+	glBindFramebuffer(GL_FRAMEBUFFER, res.previous_buffer);
+	glViewport(res.previous_viewport[0], res.previous_viewport[1], res.previous_viewport[2], res.previous_viewport[3]);
+}
+
+void draw_dynamic_resolution(DynamicResolution& res) {
+	//rows are counted from the bottom of the texture, so the flipped source starts at 0
+	draw_texture_EX(res.buffer.texture, rect(0, 0, res.scaled_width, res.scaled_height),
+		rect(0, 0, get_window_width(), get_window_height())
+	);
+}
+
+void dispose_dynamic_resolution(DynamicResolution& res) {
+	if (res.buffer.ID != 0)
+		dispose_framebuffer(res.buffer);
+	res.buffer.ID = 0;
+	res.width = res.height = 0;
 }
 
 f32 get_blackbar_width(f32 aspect) {
@@ -1026,9 +2672,22 @@ Rect fit_aspect_ratio(f32 aspect) {
 }
 
 void dispose2D() {
-	glDeleteVertexArrays(1, &vao);
-	glDeleteBuffers(1, &vbo);
-	glDeleteBuffers(1, &ebo);
+	{
+		std::lock_guard<std::mutex> lock(command_lists_lock);
+		for (u32 i = 0; i < command_lists.size(); ++i)
+			delete command_lists[i];
+		for (u32 i = 0; i < free_command_lists.size(); ++i)
+			delete free_command_lists[i];
+		command_lists.clear();
+		free_command_lists.clear();
+		//lists cached by other threads are now stale and get replaced on their next use
+		command_generation++;
+	}
+	release_batch_buffers();
+	if (stats_queries[0][0] != 0) {
+		glDeleteQueries(RENDER_STATS_QUERY_FRAMES * RENDER_STATS_QUERIES, &stats_queries[0][0]);
+		memset(stats_queries, 0, sizeof(stats_queries));
+	}
 	dispose_shader(shader);
 }
 
@@ -52,6 +52,7 @@ Shader load_shader_2D(const GLchar* vertexfile, const GLchar* fragmentfile) {
 	glBindAttribLocation(shader.ID, 1, "color");
 	glBindAttribLocation(shader.ID, 2, "uv");
 	glBindAttribLocation(shader.ID, 3, "texid");
+	glBindAttribLocation(shader.ID, 4, "blend");
 	glLinkProgram(shader.ID);
 	glValidateProgram(shader.ID);
 
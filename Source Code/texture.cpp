@@ -28,6 +28,10 @@
 
 #include "texture.h"
 #include <SOIL.h>
+#include <algorithm>
+#if defined(BMT_SSE2)
+#include <emmintrin.h>
+#endif
 
 #if defined(BMT_USE_NAMESPACE) 
 namespace bmt {
@@ -39,6 +43,7 @@ namespace bmt {
 struct TexData {
 	char* identifier;
 	Texture texture;
+	bool premultiplied;
 };
 
 INTERNAL
@@ -53,6 +58,27 @@ char* createUniqueName() {
 INTERNAL u16 loaded_textures_size = 1;
 INTERNAL u16 num_loaded_textures = 0;
 INTERNAL TexData* loaded_textures = (TexData*)malloc(loaded_textures_size * sizeof(TexData));
+INTERNAL TextureAtlas* active_atlas = NULL;
+//atlases that have textures packed into them and are not disposed yet
+INTERNAL std::vector<TextureAtlas*> live_atlases;
+
+#if defined(_PREVENT_MULTIPLE_TEXTURES)
+INTERNAL
+void remember_texture(const char* filepath, Texture texture) {
+	loaded_textures[num_loaded_textures].identifier = duplicate_string(filepath);
+	loaded_textures[num_loaded_textures].texture = texture;
+	loaded_textures[num_loaded_textures].premultiplied = texture.premultiplied;
+	num_loaded_textures++;
+
+	if (num_loaded_textures == loaded_textures_size) {
+		if (loaded_textures_size * 2 >= MAX_LOADED_TEXTURES)
+			loaded_textures_size = MAX_LOADED_TEXTURES;
+		else
+			loaded_textures_size *= 2;
+		loaded_textures = (TexData*)realloc(loaded_textures, loaded_textures_size * sizeof(TexData));
+	}
+}
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -69,11 +95,21 @@ Texture create_blank_texture(u32 width, u32 height) {
 	texture.width = width;
 	texture.height = height;
 	texture.flip_flag = 0;
+	texture.target = GL_TEXTURE_2D;
+	texture.layer = 0;
+	texture.region = rect(0, 0, 0, 0);
+	texture.premultiplied = false;
+	texture.atlas = NULL;
 
 	return texture;
 }
 
 Texture load_texture(unsigned char* pixels, u32 width, u32 height, u16 param) {
+	if (active_atlas != NULL && param == active_atlas->param && width + active_atlas->padding <= active_atlas->page_width 
+		&& height + active_atlas->padding <= active_atlas->page_height) {
+		return add_atlas_texture(*active_atlas, pixels, width, height);
+	}
+
 	Texture texture;
 	texture.width = width;
 	texture.height = height;
@@ -87,14 +123,19 @@ Texture load_texture(unsigned char* pixels, u32 width, u32 height, u16 param) {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, param);
 	glBindTexture(GL_TEXTURE_2D, 0);
 	texture.flip_flag = 0;
+	texture.target = GL_TEXTURE_2D;
+	texture.layer = 0;
+	texture.region = rect(0, 0, 0, 0);
+	texture.premultiplied = false;
+	texture.atlas = NULL;
 
 	return texture;
 }
 
-Texture load_texture(const char* filepath, u16 param) {
+Texture load_texture(const char* filepath, u16 param, bool premultiply) {
 #if defined(_PREVENT_MULTIPLE_TEXTURES)
 	for (u16 i = 0; i < num_loaded_textures; ++i) {
-		if (strcmp(loaded_textures[i].identifier, filepath) == 0) {
+		if (strcmp(loaded_textures[i].identifier, filepath) == 0 && loaded_textures[i].premultiplied == premultiply) {
 			BMT_LOG(INFO, "[%s] This texture has already been loaded into VRAM. \
 			\nReturning a copy of the already loaded texture.", filepath);
 			return loaded_textures[i].texture;
@@ -102,7 +143,44 @@ Texture load_texture(const char* filepath, u16 param) {
 	}
 #endif
 
-	Texture texture;
+	//premultiplying needs the pixels on the CPU, the pixel overload then handles the atlas
+	if (premultiply) {
+		i32 width, height;
+		unsigned char* image = SOIL_load_image(filepath, &width, &height, 0, SOIL_LOAD_RGBA);
+		if (image == NULL) {
+			BMT_LOG(WARNING, "[%s] Texture could not be loaded!", filepath);
+			Texture texture = { 0 };
+			return texture;
+		}
+		premultiply_alpha(image, width, height);
+		Texture texture = load_texture(image, width, height, param);
+		texture.premultiplied = true;
+		SOIL_free_image_data(image);
+#if defined(_PREVENT_MULTIPLE_TEXTURES)
+		remember_texture(filepath, texture);
+#endif
+		return texture;
+	}
+
+	//decoded once, the pixel overload packs the image or gives it its own texture if it does not fit
+	if (active_atlas != NULL && param == active_atlas->param) {
+		i32 width, height;
+		unsigned char* image = SOIL_load_image(filepath, &width, &height, 0, SOIL_LOAD_RGBA);
+		if (image == NULL) {
+			BMT_LOG(WARNING, "[%s] Texture could not be loaded!", filepath);
+			Texture texture = { 0 };
+			return texture;
+		}
+		Texture texture = load_texture(image, width, height, param);
+		SOIL_free_image_data(image);
+#if defined(_PREVENT_MULTIPLE_TEXTURES)
+		remember_texture(filepath, texture);
+#endif
+		return texture;
+	}
+
+	Texture texture = { 0 };
+	texture.target = GL_TEXTURE_2D;
 	glGenTextures(1, &texture.ID);
 	glBindTexture(GL_TEXTURE_2D, texture.ID);
 	unsigned char* image = SOIL_load_image(filepath, &texture.width, &texture.height, 0, SOIL_LOAD_RGBA);
@@ -110,20 +188,7 @@ Texture load_texture(const char* filepath, u16 param) {
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.width, texture.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
 
 #if defined(_PREVENT_MULTIPLE_TEXTURES)
-		loaded_textures[num_loaded_textures].identifier = duplicate_string(filepath);
-		loaded_textures[num_loaded_textures].texture.ID = texture.ID;
-		loaded_textures[num_loaded_textures].texture.height = texture.height;
-		loaded_textures[num_loaded_textures].texture.width = texture.width;
-		loaded_textures[num_loaded_textures].texture.flip_flag = 0;
-		num_loaded_textures++;
-
-		if (num_loaded_textures == loaded_textures_size) {
-			if (loaded_textures_size * 2 >= MAX_LOADED_TEXTURES)
-				loaded_textures_size = MAX_LOADED_TEXTURES;
-			else
-				loaded_textures_size *= 2;
-			loaded_textures = (TexData*)realloc(loaded_textures, loaded_textures_size * sizeof(TexData));
-		}
+		remember_texture(filepath, texture);
 #endif
 
 	}
@@ -138,6 +203,11 @@ Texture load_texture(const char* filepath, u16 param) {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, param);
 	glBindTexture(GL_TEXTURE_2D, 0);
 	texture.flip_flag = 0;
+	texture.target = GL_TEXTURE_2D;
+	texture.layer = 0;
+	texture.region = rect(0, 0, 0, 0);
+	texture.premultiplied = false;
+	texture.atlas = NULL;
 
 	return texture;
 }
@@ -145,7 +215,8 @@ Texture load_texture(const char* filepath, u16 param) {
 void dispose_texture(Texture& texture) {
 #if defined(_PREVENT_MULTIPLE_TEXTURES)
 	for (u16 i = 0; i < num_loaded_textures; ++i) {
-		if (texture.ID == loaded_textures[i].texture.ID) {
+		if (texture.ID == loaded_textures[i].texture.ID && texture.region.x == loaded_textures[i].texture.region.x 
+			&& texture.region.y == loaded_textures[i].texture.region.y) {
 			loaded_textures_size--;
 			for (u16 j = 0; j < loaded_textures_size; ++j)
 				loaded_textures[j] = loaded_textures[j + 1];
@@ -153,31 +224,556 @@ void dispose_texture(Texture& texture) {
 		}
 	}
 #endif
+	//atlas textures share their page, only their area is given back
+	if (texture.region.width != 0) {
+		if (std::find(live_atlases.begin(), live_atlases.end(), texture.atlas) != live_atlases.end())
+			remove_atlas_texture(*texture.atlas, texture);
+		else
+			BMT_LOG(WARNING, "Texture #%d is part of an atlas, dispose the atlas instead", texture.ID);
+		texture.ID = 0;
+		return;
+	}
 	glDeleteTextures(1, &texture.ID);
 	texture.ID = 0;
 }
 
-void set_texture_pixels(Texture texture, unsigned char* pixels, u32 width, u32 height) {
+//==========================================================================================
+//Description: Computes color * alpha / 255 for the three color channels of one pixel,
+//	rounded to nearest
+//==========================================================================================
+INTERNAL inline
+void premultiply_pixel(unsigned char* pixel) {
+	u32 alpha = pixel[3];
+	for (u32 i = 0; i < 3; ++i) {
+		u32 product = pixel[i] * alpha + 128;
+		pixel[i] = (unsigned char)((product + (product >> 8)) >> 8);
+	}
+}
+
+void premultiply_alpha(unsigned char* pixels, u32 width, u32 height) {
+	u32 count = width * height;
+	u32 i = 0;
+#if defined(BMT_SSE2)
+	//four pixels at a time, widened to 16 bits. Alpha is multiplied by 255 so the same 
+	//divide by 255 leaves it unchanged.
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i colormask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+	const __m128i alphaone = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+	const __m128i half = _mm_set1_epi16(128);
+	for (; i + 4 <= count; i += 4) {
+		__m128i rgba = _mm_loadu_si128((const __m128i*)(pixels + i * 4));
+		__m128i halves[2] = { _mm_unpacklo_epi8(rgba, zero), _mm_unpackhi_epi8(rgba, zero) };
+		for (u32 j = 0; j < 2; ++j) {
+			__m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(halves[j], _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+			alpha = _mm_or_si128(_mm_and_si128(alpha, colormask), alphaone);
+			__m128i product = _mm_add_epi16(_mm_mullo_epi16(halves[j], alpha), half);
+			halves[j] = _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+		}
+		_mm_storeu_si128((__m128i*)(pixels + i * 4), _mm_packus_epi16(halves[0], halves[1]));
+	}
+#endif
+	for (; i < count; ++i)
+		premultiply_pixel(pixels + i * 4);
+}
+
+//==========================================================================================
+//Description: Replaces the pixels of a texture. A layer of a texture array or a texture
+//	packed into an atlas only owns part of its GL texture, so it is written in place and 
+//	has to keep its size.
+//==========================================================================================
+INTERNAL
+void upload_texture_pixels(const Texture& texture, unsigned char* pixels, i32 width, i32 height) {
+	if (texture.target == GL_TEXTURE_2D_ARRAY) {
+		if (width != texture.width || height != texture.height) {
+			BMT_LOG(WARNING, "Texture #%d is a %dx%d layer of a texture array and can not be resized to %dx%d", 
+				texture.ID, texture.width, texture.height, width, height
+			);
+			return;
+		}
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture.ID);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, texture.layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		return;
+	}
+	if (texture.region.width != 0) {
+		if (width != texture.width || height != texture.height) {
+			BMT_LOG(WARNING, "Texture #%d is a %dx%d area of an atlas page and can not be resized to %dx%d", 
+				texture.ID, texture.width, texture.height, width, height
+			);
+			return;
+		}
+		i32 x = (i32)floor(texture.region.x * texture.width / texture.region.width + 0.5f);
+		i32 y = (i32)floor(texture.region.y * texture.height / texture.region.height + 0.5f);
+		glBindTexture(GL_TEXTURE_2D, texture.ID);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return;
+	}
 	glBindTexture(GL_TEXTURE_2D, texture.ID);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.width, texture.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
+
+void set_texture_pixels(Texture texture, unsigned char* pixels, u32 width, u32 height) {
+	upload_texture_pixels(texture, pixels, texture.width, texture.height);
+}
 void set_texture_pixels_from_file(Texture texture, const char* filepath) {
-	glBindTexture(GL_TEXTURE_2D, texture.ID);
-	unsigned char* image = SOIL_load_image(filepath, &texture.width, &texture.height, 0, SOIL_LOAD_RGBA);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.width, texture.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+	i32 width, height;
+	unsigned char* image = SOIL_load_image(filepath, &width, &height, 0, SOIL_LOAD_RGBA);
+	if (image == NULL) {
+		BMT_LOG(WARNING, "[%s] Texture could not be loaded!", filepath);
+		return;
+	}
+	upload_texture_pixels(texture, image, width, height);
 	SOIL_free_image_data(image);
-	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 void bind_texture(Texture texture, u32 slot) {
 	glActiveTexture(GL_TEXTURE0 + slot);
-	glBindTexture(GL_TEXTURE_2D, texture.ID);
+	glBindTexture(texture.target == GL_TEXTURE_2D_ARRAY ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, texture.ID);
 }
 
 void unbind_texture(u32 slot) {
 	glActiveTexture(GL_TEXTURE0 + slot);
 	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+TextureArray create_texture_array(u32 width, u32 height, u32 layers, u16 param) {
+	TextureArray array;
+	array.width = width;
+	array.height = height;
+	array.layers = layers;
+	array.layercount = 0;
+
+	glGenTextures(1, &array.ID);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, array.ID);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, param);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, param);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	return array;
+}
+
+Texture add_texture_layer(TextureArray& array, unsigned char* pixels) {
+	Texture texture = { 0 };
+	if (array.layercount >= array.layers) {
+		BMT_LOG(WARNING, "Texture array #%d is full (%d layers)", array.ID, array.layers);
+		return texture;
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, array.ID);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, array.layercount, array.width, array.height, 1,
+		GL_RGBA, GL_UNSIGNED_BYTE, pixels
+	);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	texture.ID = array.ID;
+	texture.width = array.width;
+	texture.height = array.height;
+	texture.flip_flag = 0;
+	texture.target = GL_TEXTURE_2D_ARRAY;
+	texture.layer = array.layercount++;
+	return texture;
+}
+
+Texture add_texture_layer(TextureArray& array, const char* filepath) {
+	Texture texture = { 0 };
+	i32 width, height;
+	unsigned char* image = SOIL_load_image(filepath, &width, &height, 0, SOIL_LOAD_RGBA);
+	if (image == NULL) {
+		BMT_LOG(WARNING, "[%s] Texture could not be loaded!", filepath);
+		return texture;
+	}
+	if (width != array.width || height != array.height) {
+		BMT_LOG(WARNING, "[%s] is %dx%d but texture array #%d holds %dx%d layers", 
+			filepath, width, height, array.ID, array.width, array.height
+		);
+	}
+	else {
+		texture = add_texture_layer(array, image);
+	}
+	SOIL_free_image_data(image);
+	return texture;
+}
+
+void dispose_texture_array(TextureArray& array) {
+	glDeleteTextures(1, &array.ID);
+	array.ID = 0;
+	array.layercount = 0;
+}
+
+//==========================================================================================
+//Description: Finds the free rectangle of a page that fits the size with the least space
+//	left over on its shorter side (MaxRects best short side fit).
+//==========================================================================================
+INTERNAL
+bool find_atlas_position(const AtlasPage& page, f32 width, f32 height, Rect* result) {
+	f32 best = FLT_MAX;
+	for (u32 i = 0; i < page.free_rects.size(); ++i) {
+		const Rect& free = page.free_rects[i];
+		if (free.width < width || free.height < height)
+			continue;
+		f32 leftover = free.width - width;
+		if (free.height - height < leftover)
+			leftover = free.height - height;
+		if (leftover < best) {
+			best = leftover;
+			*result = rect(free.x, free.y, width, height);
+		}
+	}
+	return best != FLT_MAX;
+}
+
+INTERNAL inline
+bool rect_contains(Rect outer, Rect inner) {
+	return inner.x >= outer.x && inner.y >= outer.y &&
+		inner.x + inner.width <= outer.x + outer.width &&
+		inner.y + inner.height <= outer.y + outer.height;
+}
+
+//==========================================================================================
+//Description: Removes free rectangles that lie entirely inside another one.
+//==========================================================================================
+INTERNAL
+void prune_free_rects(std::vector<Rect>& rects) {
+	for (u32 i = 0; i < rects.size(); ++i) {
+		for (u32 j = i + 1; j < rects.size(); ++j) {
+			if (rect_contains(rects[j], rects[i])) {
+				rects.erase(rects.begin() + i);
+				--i;
+				break;
+			}
+			if (rect_contains(rects[i], rects[j])) {
+				rects.erase(rects.begin() + j);
+				--j;
+			}
+		}
+	}
+}
+
+//==========================================================================================
+//Description: Takes a newly used area out of a page, splitting every free rectangle it 
+//	overlaps into the (up to four) maximal rectangles around it.
+//==========================================================================================
+INTERNAL
+void occupy_atlas_rect(AtlasPage& page, Rect used) {
+	std::vector<Rect> next;
+	next.reserve(page.free_rects.size() + 4);
+	for (u32 i = 0; i < page.free_rects.size(); ++i) {
+		Rect free = page.free_rects[i];
+		if (used.x >= free.x + free.width || used.x + used.width <= free.x ||
+			used.y >= free.y + free.height || used.y + used.height <= free.y) {
+			next.push_back(free);
+			continue;
+		}
+		if (used.x > free.x)
+			next.push_back(rect(free.x, free.y, used.x - free.x, free.height));
+		if (used.x + used.width < free.x + free.width)
+			next.push_back(rect(used.x + used.width, free.y, free.x + free.width - (used.x + used.width), free.height));
+		if (used.y > free.y)
+			next.push_back(rect(free.x, free.y, free.width, used.y - free.y));
+		if (used.y + used.height < free.y + free.height)
+			next.push_back(rect(free.x, used.y + used.height, free.width, free.y + free.height - (used.y + used.height)));
+	}
+	prune_free_rects(next);
+	page.free_rects.swap(next);
+}
+
+//==========================================================================================
+//Description: Joins free rectangles that share a whole edge, so space given back by 
+//	removed textures can hold larger textures again.
+//==========================================================================================
+INTERNAL
+void merge_free_rects(std::vector<Rect>& rects) {
+	bool merged = true;
+	while (merged) {
+		merged = false;
+		for (u32 i = 0; i < rects.size() && !merged; ++i) {
+			for (u32 j = i + 1; j < rects.size(); ++j) {
+				Rect& a = rects[i];
+				Rect& b = rects[j];
+				if (a.x == b.x && a.width == b.width && (a.y + a.height == b.y || b.y + b.height == a.y)) {
+					a = rect(a.x, (a.y < b.y ? a.y : b.y), a.width, a.height + b.height);
+				}
+				else if (a.y == b.y && a.height == b.height && (a.x + a.width == b.x || b.x + b.width == a.x)) {
+					a = rect((a.x < b.x ? a.x : b.x), a.y, a.width + b.width, a.height);
+				}
+				else {
+					continue;
+				}
+				rects.erase(rects.begin() + j);
+				merged = true;
+				break;
+			}
+		}
+	}
+	prune_free_rects(rects);
+}
+
+INTERNAL
+AtlasPage create_atlas_page(const TextureAtlas& atlas) {
+	AtlasPage page;
+	//cleared so the padding between textures is transparent
+	unsigned char* pixels = (unsigned char*)calloc(atlas.page_width * atlas.page_height, 4);
+	page.texture = create_blank_texture(atlas.page_width, atlas.page_height);
+	glBindTexture(GL_TEXTURE_2D, page.texture.ID);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, atlas.page_width, atlas.page_height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, atlas.param);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, atlas.param);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	free(pixels);
+
+	page.free_rects.push_back(rect(0, 0, atlas.page_width, atlas.page_height));
+	BMT_LOG(INFO, "Texture atlas page #%d created (%dx%d)", page.texture.ID, atlas.page_width, atlas.page_height);
+	return page;
+}
+
+TextureAtlas create_texture_atlas(u32 page_width, u32 page_height, u16 param, u32 padding) {
+	TextureAtlas atlas;
+	atlas.page_width = page_width;
+	atlas.page_height = page_height;
+	atlas.padding = padding;
+	atlas.param = param;
+	return atlas;
+}
+
+Texture add_atlas_texture(TextureAtlas& atlas, unsigned char* pixels, u32 width, u32 height) {
+	Texture texture = { 0 };
+	f32 paddedwidth = width + atlas.padding;
+	f32 paddedheight = height + atlas.padding;
+	if (paddedwidth > atlas.page_width || paddedheight > atlas.page_height) {
+		BMT_LOG(WARNING, "A %dx%d texture does not fit in a %dx%d atlas page", 
+			width, height, atlas.page_width, atlas.page_height
+		);
+		return texture;
+	}
+
+	Rect placed;
+	u32 pageindex = 0;
+	while (pageindex < atlas.pages.size() && !find_atlas_position(atlas.pages[pageindex], paddedwidth, paddedheight, &placed))
+		pageindex++;
+	if (pageindex == atlas.pages.size()) {
+		atlas.pages.push_back(create_atlas_page(atlas));
+		find_atlas_position(atlas.pages[pageindex], paddedwidth, paddedheight, &placed);
+	}
+	AtlasPage& page = atlas.pages[pageindex];
+	occupy_atlas_rect(page, placed);
+	page.used_rects.push_back(placed);
+	if (std::find(live_atlases.begin(), live_atlases.end(), &atlas) == live_atlases.end())
+		live_atlases.push_back(&atlas);
+
+	glBindTexture(GL_TEXTURE_2D, page.texture.ID);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, placed.x, placed.y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	texture.ID = page.texture.ID;
+	texture.width = width;
+	texture.height = height;
+	texture.flip_flag = 0;
+	texture.target = GL_TEXTURE_2D;
+	texture.layer = 0;
+	texture.region = rect(
+		placed.x / atlas.page_width, placed.y / atlas.page_height,
+		(f32)width / atlas.page_width, (f32)height / atlas.page_height
+	);
+	texture.atlas = &atlas;
+	return texture;
+}
+
+Texture add_atlas_texture(TextureAtlas& atlas, const char* filepath) {
+	Texture texture = { 0 };
+	i32 width, height;
+	unsigned char* image = SOIL_load_image(filepath, &width, &height, 0, SOIL_LOAD_RGBA);
+	if (image == NULL) {
+		BMT_LOG(WARNING, "[%s] Texture could not be loaded!", filepath);
+		return texture;
+	}
+	texture = add_atlas_texture(atlas, image, width, height);
+	SOIL_free_image_data(image);
+	return texture;
+}
+
+void remove_atlas_texture(TextureAtlas& atlas, Texture& texture) {
+	for (u32 i = 0; i < atlas.pages.size(); ++i) {
+		AtlasPage& page = atlas.pages[i];
+		if (page.texture.ID != texture.ID)
+			continue;
+
+		f32 x = floor(texture.region.x * atlas.page_width + 0.5f);
+		f32 y = floor(texture.region.y * atlas.page_height + 0.5f);
+		u32 used = 0;
+		while (used < page.used_rects.size() && (page.used_rects[used].x != x || page.used_rects[used].y != y))
+			used++;
+		//another copy of this texture already gave the area back
+		if (used == page.used_rects.size()) {
+			BMT_LOG(WARNING, "Texture #%d at (%d, %d) was already removed from the atlas", texture.ID, (i32)x, (i32)y);
+			texture.ID = 0;
+			return;
+		}
+		page.used_rects.erase(page.used_rects.begin() + used);
+
+		page.free_rects.push_back(rect(x, y, texture.width + atlas.padding, texture.height + atlas.padding));
+		merge_free_rects(page.free_rects);
+		texture.ID = 0;
+		return;
+	}
+	BMT_LOG(WARNING, "Texture #%d is not part of this atlas", texture.ID);
+}
+
+void dispose_texture_atlas(TextureAtlas& atlas) {
+	for (u32 i = 0; i < atlas.pages.size(); ++i)
+		glDeleteTextures(1, &atlas.pages[i].texture.ID);
+	atlas.pages.clear();
+	if (active_atlas == &atlas)
+		active_atlas = NULL;
+	live_atlases.erase(std::remove(live_atlases.begin(), live_atlases.end(), &atlas), live_atlases.end());
+}
+
+void set_texture_atlas(TextureAtlas* atlas) {
+	active_atlas = atlas;
+}
+
+Readback create_readback() {
+	Readback readback = {};
+	for (u32 i = 0; i < READBACK_RING_SIZE; ++i)
+		glGenBuffers(1, &readback.slots[i].pbo);
+	readback.synced = GLEW_VERSION_3_2 || GLEW_ARB_sync;
+	if (!readback.synced)
+		BMT_LOG(WARNING, "Sync objects are not supported, picking up a readback waits for the GPU");
+	return readback;
+}
+
+//==========================================================================================
+//Description: Starts an asynchronous glReadPixels of the bound read framebuffer into the 
+//	next slot's pixel buffer and fences it.
+//==========================================================================================
+INTERNAL
+bool queue_readback(Readback& readback, i32 x, i32 y, u32 width, u32 height, ReadbackCallback callback, void* userdata) {
+	ReadbackSlot& slot = readback.slots[readback.head];
+	if (slot.pending || width == 0 || height == 0)
+		return false;
+
+	GLsizeiptr size = (GLsizeiptr)width * height * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	if (size > slot.capacity) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		slot.capacity = size;
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	//without a fence mapping the buffer in deliver_readback() waits for the copy
+	slot.fence = readback.synced ? glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : 0;
+	slot.pending = true;
+	slot.width = width;
+	slot.height = height;
+	slot.callback = callback;
+	slot.userdata = userdata;
+	readback.head = (readback.head + 1) % READBACK_RING_SIZE;
+	return true;
+}
+
+bool request_readback(Readback& readback, i32 x, i32 y, u32 width, u32 height, ReadbackCallback callback, void* userdata) {
+	GLint previous;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	bool queued = queue_readback(readback, x, y, width, height, callback, userdata);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, previous);
+	return queued;
+}
+
+bool request_readback(Readback& readback, Framebuffer buffer, ReadbackCallback callback, void* userdata) {
+	GLint previous;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, buffer.ID);
+	bool queued = queue_readback(readback, 0, 0, buffer.texture.width, buffer.texture.height, callback, userdata);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, previous);
+	return queued;
+}
+
+//==========================================================================================
+//Description: Returns whether the oldest read in flight has landed in its buffer, without
+//	waiting for it.
+//==========================================================================================
+INTERNAL
+bool readback_finished(ReadbackSlot& slot) {
+	if (!slot.pending)
+		return false;
+	if (slot.fence != 0) {
+		GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+			return false;
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+	}
+	return true;
+}
+
+//==========================================================================================
+//Description: Maps a finished slot, hands its pixels to the callback (or copies them into 
+//	pixels) and frees the slot.
+//==========================================================================================
+INTERNAL
+void deliver_readback(Readback& readback, unsigned char* pixels) {
+	ReadbackSlot& slot = readback.slots[readback.tail];
+	GLsizeiptr size = (GLsizeiptr)slot.width * slot.height * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	const unsigned char* mapped = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+	if (mapped != NULL) {
+		if (pixels != NULL)
+			memcpy(pixels, mapped, size);
+		else
+			slot.callback(mapped, slot.width, slot.height, slot.userdata);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	else {
+		BMT_LOG(WARNING, "Could not map readback buffer #%d", slot.pbo);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.pending = false;
+	readback.tail = (readback.tail + 1) % READBACK_RING_SIZE;
+}
+
+u32 update_readback(Readback& readback) {
+	u32 delivered = 0;
+	for (u32 i = 0; i < READBACK_RING_SIZE; ++i) {
+		ReadbackSlot& slot = readback.slots[readback.tail];
+		if (slot.callback == NULL || !readback_finished(slot))
+			break;
+		deliver_readback(readback, NULL);
+		delivered++;
+	}
+	return delivered;
+}
+
+bool poll_readback(Readback& readback, unsigned char* pixels, u32* width, u32* height) {
+	ReadbackSlot& slot = readback.slots[readback.tail];
+	if (slot.callback != NULL || pixels == NULL || !readback_finished(slot))
+		return false;
+	if (width != NULL)
+		*width = slot.width;
+	if (height != NULL)
+		*height = slot.height;
+	deliver_readback(readback, pixels);
+	return true;
+}
+
+void dispose_readback(Readback& readback) {
+	for (u32 i = 0; i < READBACK_RING_SIZE; ++i) {
+		ReadbackSlot& slot = readback.slots[i];
+		if (slot.fence != 0)
+			glDeleteSync(slot.fence);
+		glDeleteBuffers(1, &slot.pbo);
+	}
+	readback = {};
 }
 
 #if defined(BMT_USE_NAMESPACE) 
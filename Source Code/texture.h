@@ -39,16 +39,75 @@ namespace bmt {
 const int FLIP_HORIZONTAL = 1;
 const int FLIP_VERTICAL = 2;
 
+struct TextureAtlas;
+
 struct Texture {
 	GLuint ID;
 	u64 flip_flag;
 	i32 width;
 	i32 height;
+	GLenum target;	//GL_TEXTURE_2D_ARRAY for a layer of a TextureArray, otherwise GL_TEXTURE_2D (or 0)
+	u32 layer;
+	Rect region;	//normalized (0 to 1) area of the GL texture this texture covers, a width of 0 means all of it
+	bool premultiplied;	//color already multiplied by alpha, see premultiply_alpha
+	TextureAtlas* atlas;	//the atlas this texture is packed into, NULL if it has its own GL texture
+};
+
+//================================================
+//Description: A stack of same-sized textures in
+//	one GL_TEXTURE_2D_ARRAY. Every layer is handed
+//	out as a regular Texture, so sprites from the
+//	same array can all be drawn in a single batch
+//	by the shader from load_array_shader_2D().
+//================================================
+struct TextureArray {
+	GLuint ID;
+	i32 width;
+	i32 height;
+	u32 layers;
+	u32 layercount;
+};
+
+//================================================
+//Description: Packs many small textures into a
+//	few large GL textures (pages) so that they can
+//	be drawn in the same batch. Textures added to
+//	an atlas share their page's ID and carry the
+//	area they cover in region.
+//================================================
+struct AtlasPage {
+	Texture texture;
+	std::vector<Rect> free_rects;
+	std::vector<Rect> used_rects;	//padded areas of the textures packed into this page
+};
+
+struct TextureAtlas {
+	u32 page_width;
+	u32 page_height;
+	u32 padding;
+	u16 param;
+	std::vector<AtlasPage> pages;
 };
 
 Texture create_blank_texture(u32 width = 0, u32 height = 0);
 Texture load_texture(unsigned char* pixels, u32 width, u32 height, u16 param);
-Texture load_texture(const char* filepath, u16 param);
+//==========================================================================================
+//Description: Loads an image file into a texture
+//
+//Parameters: 
+//		-A path to the image
+//		-The filtering of the texture (GL_NEAREST or GL_LINEAR)
+//		-(OPTIONAL) Whether to premultiply the colors by alpha (default = false)
+//
+//Comments: Premultiplied textures filter without dark fringes around transparent edges,
+//		and the default 2D shaders can mix them with straight alpha textures and with
+//		additive sprites in one batch (see set_blend_mode_2D).
+//==========================================================================================
+Texture load_texture(const char* filepath, u16 param, bool premultiply = false);
+//==========================================================================================
+//Description: Multiplies the color of RGBA pixels by their alpha, in place
+//==========================================================================================
+void premultiply_alpha(unsigned char* pixels, u32 width, u32 height);
 void dispose_texture(Texture& texture);
 
 void set_texture_pixels(Texture texture, unsigned char* pixels, u32 width, u32 height);
@@ -57,6 +116,65 @@ void set_texture_pixels_from_file(Texture texture, const char* filepath);
 void bind_texture(Texture texture, u32 slot);
 void unbind_texture(u32 slot);
 
+//==========================================================================================
+//Description: Creates an empty texture array that layers can be added to
+//
+//Parameters: 
+//		-The width and height every layer must have
+//		-The maximum number of layers
+//		-The filtering param (GL_NEAREST, GL_LINEAR)
+//==========================================================================================
+TextureArray create_texture_array(u32 width, u32 height, u32 layers, u16 param);
+//==========================================================================================
+//Description: Uploads pixels (or an image file) into the next free layer of the array
+//
+//Comments: Returns a texture with an ID of 0 if the array is full or the image is not
+//		the same size as the array. The returned texture belongs to the array, dispose
+//		the array with dispose_texture_array() instead of disposing its layers.
+//==========================================================================================
+Texture add_texture_layer(TextureArray& array, unsigned char* pixels);
+Texture add_texture_layer(TextureArray& array, const char* filepath);
+void dispose_texture_array(TextureArray& array);
+
+//==========================================================================================
+//Description: Creates an empty texture atlas. Pages are created as textures are added.
+//
+//Parameters: 
+//		-(OPTIONAL) The width and height of every page (default = 2048x2048)
+//		-(OPTIONAL) The filtering param (GL_NEAREST, GL_LINEAR) (default = GL_NEAREST)
+//		-(OPTIONAL) Empty pixels kept between packed textures so filtering does not 
+//			bleed neighbours in (default = 1)
+//==========================================================================================
+TextureAtlas create_texture_atlas(u32 page_width = 2048, u32 page_height = 2048, u16 param = GL_NEAREST, u32 padding = 1);
+//==========================================================================================
+//Description: Packs pixels (or an image file) into the atlas
+//
+//Comments: Returns a texture with an ID of 0 if the image is larger than a page. 
+//		The returned texture draws like any other texture.
+//==========================================================================================
+Texture add_atlas_texture(TextureAtlas& atlas, unsigned char* pixels, u32 width, u32 height);
+Texture add_atlas_texture(TextureAtlas& atlas, const char* filepath);
+//==========================================================================================
+//Description: Frees the area a texture covers so later textures can be packed into it
+//
+//Comments: An area is only freed once, removing another copy of the same texture does
+//		nothing.
+//==========================================================================================
+void remove_atlas_texture(TextureAtlas& atlas, Texture& texture);
+void dispose_texture_atlas(TextureAtlas& atlas);
+//==========================================================================================
+//Description: Makes load_texture() pack into the given atlas instead of creating a GL
+//	texture per image. Pass NULL to go back to separate textures.
+//
+//Comments: Images larger than a page, or loaded with a different filtering param than
+//		the atlas, still get their own texture. dispose_texture() on a texture from the
+//		atlas removes it from the atlas it was packed into, so that atlas must stay where
+//		it is until its textures are disposed. set_texture_pixels() writes an atlas texture in
+//		place and can not change its size. Only the 2D renderer maps 
+//		atlas regions, textures meant for render3D should be loaded without an atlas.
+//==========================================================================================
+void set_texture_atlas(TextureAtlas* atlas);
+
 //==========================================================================================
 //Description: Sets the wrap_x of the texture (horizontal wrapping)
 //
@@ -64,12 +182,17 @@ void unbind_texture(u32 slot);
 //		-A texture to set parameter of
 //		-The type of wrapping to do
 //
-//Comments: Unbinds whatever is in slot 0
+//Comments: Unbinds whatever is in slot 0. Textures packed into an atlas are left alone,
+//		on a layer of a texture array it changes the wrapping of every layer.
 //==========================================================================================
 INTERNAL inline
 void set_texture_wrap_x(Texture texture, u32 type) {
+	if (texture.region.width != 0) {
+		BMT_LOG(WARNING, "Texture #%d is part of an atlas, its wrapping is shared by the whole page", texture.ID);
+		return;
+	}
 	bind_texture(texture, 0);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, type);
+	glTexParameteri(texture.target == GL_TEXTURE_2D_ARRAY ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, type);
 	unbind_texture(0);
 }
 
@@ -80,12 +203,17 @@ void set_texture_wrap_x(Texture texture, u32 type) {
 //		-A texture to set parameter of
 //		-The type of wrapping to do
 //
-//Comments: Unbinds whatever is in slot 0
+//Comments: Unbinds whatever is in slot 0. Textures packed into an atlas are left alone,
+//		on a layer of a texture array it changes the wrapping of every layer.
 //==========================================================================================
 INTERNAL inline
 void set_texture_wrap_y(Texture texture, u32 type) {
+	if (texture.region.width != 0) {
+		BMT_LOG(WARNING, "Texture #%d is part of an atlas, its wrapping is shared by the whole page", texture.ID);
+		return;
+	}
 	bind_texture(texture, 0);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, type);
+	glTexParameteri(texture.target == GL_TEXTURE_2D_ARRAY ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, type);
 	unbind_texture(0);
 }
 
@@ -105,6 +233,11 @@ Framebuffer create_framebuffer(u32 width, u32 height, u16 param, u8 buffertype)
 	buffer.texture.width = width;
 	buffer.texture.height = height;
 	buffer.texture.flip_flag = 0;
+	buffer.texture.target = GL_TEXTURE_2D;
+	buffer.texture.layer = 0;
+	buffer.texture.region = rect(0, 0, 0, 0);
+	buffer.texture.premultiplied = false;
+	buffer.texture.atlas = NULL;
 
 	glGenTextures(1, &buffer.texture.ID);
 	glBindTexture(GL_TEXTURE_2D, buffer.texture.ID);
@@ -166,6 +299,84 @@ void unbind_framebuffer() {
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+//number of reads a Readback can have in flight before request_readback() starts refusing
+#ifndef READBACK_RING_SIZE
+#define READBACK_RING_SIZE	3
+#endif
+
+//receives the pixels of a finished read as RGBA rows from bottom to top (the order GL 
+//stores them in). The pixels are only valid during the call.
+typedef void (*ReadbackCallback)(const unsigned char* pixels, u32 width, u32 height, void* userdata);
+
+struct ReadbackSlot {
+	GLuint pbo;
+	GLsizeiptr capacity;
+	GLsync fence;
+	bool pending;
+	u32 width;
+	u32 height;
+	ReadbackCallback callback;
+	void* userdata;
+};
+
+//================================================
+//Description: A ring of pixel buffer objects that
+//	reads the window or a framebuffer without 
+//	waiting on the GPU. The copy is queued with a 
+//	fence and the pixels are picked up a frame or
+//	two later, when the fence has signaled. 
+//	Without sync objects (GL 3.2 or ARB_sync) 
+//	reads count as finished right away and 
+//	picking one up waits for the GPU.
+//================================================
+struct Readback {
+	ReadbackSlot slots[READBACK_RING_SIZE];
+	u32 head;	//next slot to read into
+	u32 tail;	//oldest read in flight
+	bool synced;
+};
+
+Readback create_readback();
+//==========================================================================================
+//Description: Queues a read of an area of the window (or of a whole framebuffer) into the 
+//	next slot of the ring
+//
+//Parameters: 
+//		-A readback ring
+//		-The area of the window to read (from the bottom left), or a color framebuffer
+//		-(OPTIONAL) A function update_readback() hands the pixels to, or NULL to pick them
+//			up with poll_readback() instead (default = NULL)
+//		-(OPTIONAL) A pointer passed on to the callback (default = NULL)
+//
+//Comments: Returns false without reading when every slot is still in flight, so capturing
+//		every frame drops frames instead of stalling. Reading the window reads the back 
+//		buffer, so call it before swapping.
+//==========================================================================================
+bool request_readback(Readback& readback, i32 x, i32 y, u32 width, u32 height, ReadbackCallback callback = NULL, void* userdata = NULL);
+bool request_readback(Readback& readback, Framebuffer buffer, ReadbackCallback callback = NULL, void* userdata = NULL);
+//==========================================================================================
+//Description: Hands every finished read to its callback, oldest first. Call it once a 
+//	frame. Returns the number of reads delivered.
+//
+//Comments: Never waits on the GPU. The callback runs on the GL thread with the buffer 
+//		mapped, copy the pixels out to hand them to another thread (to write them to disk, 
+//		for example). Stops at a read without a callback until poll_readback() takes it.
+//==========================================================================================
+u32 update_readback(Readback& readback);
+//==========================================================================================
+//Description: Copies the oldest read into pixels if it has finished and was requested 
+//	without a callback
+//
+//Parameters: 
+//		-A readback ring
+//		-Room for width * height * 4 bytes of the read
+//		-(OPTIONAL) Where to store the size of the read
+//
+//Comments: Returns false, leaving pixels untouched, when the read has not finished yet.
+//==========================================================================================
+bool poll_readback(Readback& readback, unsigned char* pixels, u32* width = NULL, u32* height = NULL);
+void dispose_readback(Readback& readback);
+
 //==========================================================================================
 //Description: Clears the bound framebuffer (by default the window)
 //
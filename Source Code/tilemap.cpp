@@ -0,0 +1,272 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                      tilemap.cpp                                //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2018 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#include "tilemap.h"
+#include <algorithm>
+
+#if defined(BMT_USE_NAMESPACE) 
+namespace bmt {
+#endif
+
+#define NO_SPRITE 0xFFFFFFFF
+
+INTERNAL inline
+Rect tile_source(const Tilemap& map, u16 tile) {
+	u32 index = map.frames[tile] - 1;
+	return rect((index % map.columns) * map.tile_width, (index / map.columns) * map.tile_height,
+		map.tile_width, map.tile_height
+	);
+}
+
+INTERNAL inline
+Rect tile_dest(const Tilemap& map, u32 x, u32 y) {
+	return rect(x * map.tile_width, y * map.tile_height, map.tile_width, map.tile_height);
+}
+
+INTERNAL inline
+bool is_animated(const Tilemap& map, u16 tile) {
+	for (u32 i = 0; i < map.animations.size(); ++i) {
+		if (map.animations[i].tile == tile)
+			return true;
+	}
+	return false;
+}
+
+//==========================================================================================
+//Description: Writes one tile into its chunk's sprite layer. Does nothing until the chunk
+//	has been built, building it writes every tile anyway.
+//==========================================================================================
+INTERNAL
+void write_tile(Tilemap& map, TilemapChunk& chunk, u32 x, u32 y, u16 tile) {
+	if (!chunk.built)
+		return;
+
+	u32 cell = (y % TILEMAP_CHUNK_SIZE) * TILEMAP_CHUNK_SIZE + (x % TILEMAP_CHUNK_SIZE);
+	u32& handle = chunk.handles[cell];
+	if (tile == EMPTY_TILE) {
+		if (handle != NO_SPRITE)
+			remove_layer_sprite(chunk.sprites, handle);
+		handle = NO_SPRITE;
+		return;
+	}
+	if (handle == NO_SPRITE)
+		handle = add_layer_sprite(chunk.sprites, map.tileset, tile_source(map, tile), tile_dest(map, x, y));
+	else
+		update_layer_sprite(chunk.sprites, handle, map.tileset, tile_source(map, tile), tile_dest(map, x, y));
+}
+
+INTERNAL
+void build_chunk(Tilemap& map, TilemapLayer& layer, u32 cx, u32 cy) {
+	TilemapChunk& chunk = layer.chunks[cy * map.chunks_x + cx];
+	chunk.sprites = create_sprite_layer(chunk.tilecount > 0 ? chunk.tilecount : 1);
+	chunk.handles.assign(TILEMAP_CHUNK_SIZE * TILEMAP_CHUNK_SIZE, NO_SPRITE);
+	chunk.built = true;
+
+	u32 endx = (cx + 1) * TILEMAP_CHUNK_SIZE;
+	u32 endy = (cy + 1) * TILEMAP_CHUNK_SIZE;
+	if (endx > map.width) endx = map.width;
+	if (endy > map.height) endy = map.height;
+	for (u32 y = cy * TILEMAP_CHUNK_SIZE; y < endy; ++y) {
+		for (u32 x = cx * TILEMAP_CHUNK_SIZE; x < endx; ++x) {
+			u16 tile = layer.tiles[y * map.width + x];
+			if (tile != EMPTY_TILE)
+				write_tile(map, chunk, x, y, tile);
+		}
+	}
+}
+
+Tilemap create_tilemap(Texture tileset, u32 tile_width, u32 tile_height, u32 width, u32 height, u32 layers) {
+	Tilemap map;
+	map.tileset = tileset;
+	map.tile_width = tile_width;
+	map.tile_height = tile_height;
+	map.columns = tileset.width / tile_width;
+	if (map.columns == 0)
+		map.columns = 1;
+	map.width = width;
+	map.height = height;
+	map.chunks_x = (width + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+	map.chunks_y = (height + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+	map.time = 0;
+
+	map.frames.resize(0x10000);
+	for (u32 i = 0; i < map.frames.size(); ++i)
+		map.frames[i] = i;
+
+	map.layers.resize(layers);
+	for (u32 i = 0; i < layers; ++i) {
+		map.layers[i].tiles.assign(width * height, EMPTY_TILE);
+		map.layers[i].chunks.resize(map.chunks_x * map.chunks_y);
+		for (u32 j = 0; j < map.layers[i].chunks.size(); ++j) {
+			map.layers[i].chunks[j].built = false;
+			map.layers[i].chunks[j].tilecount = 0;
+		}
+	}
+	return map;
+}
+
+void set_tile(Tilemap& map, u32 layer, u32 x, u32 y, u16 tile) {
+	if (layer >= map.layers.size() || x >= map.width || y >= map.height) {
+		BMT_LOG(WARNING, "Tile (%d, %d) on layer %d is outside the tilemap", x, y, layer);
+		return;
+	}
+	TilemapLayer& tiles = map.layers[layer];
+	u16& current = tiles.tiles[y * map.width + x];
+	if (current == tile)
+		return;
+
+	TilemapChunk& chunk = tiles.chunks[(y / TILEMAP_CHUNK_SIZE) * map.chunks_x + (x / TILEMAP_CHUNK_SIZE)];
+	if (current == EMPTY_TILE)
+		chunk.tilecount++;
+	else if (tile == EMPTY_TILE)
+		chunk.tilecount--;
+
+	u32 cell = y * map.width + x;
+	if (is_animated(map, current))
+		chunk.animated.erase(std::remove(chunk.animated.begin(), chunk.animated.end(), cell), chunk.animated.end());
+	if (is_animated(map, tile))
+		chunk.animated.push_back(cell);
+
+	current = tile;
+	write_tile(map, chunk, x, y, tile);
+}
+
+u16 get_tile(Tilemap& map, u32 layer, u32 x, u32 y) {
+	if (layer >= map.layers.size() || x >= map.width || y >= map.height)
+		return EMPTY_TILE;
+	return map.layers[layer].tiles[y * map.width + x];
+}
+
+void add_tile_animation(Tilemap& map, u16 tile, u16 frames, f32 frame_time) {
+	//written as !(> 0) so a NaN frame time is rejected too
+	if (tile == EMPTY_TILE || frames == 0 || !(frame_time > 0) || is_animated(map, tile))
+		return;
+
+	TileAnimation animation;
+	animation.tile = tile;
+	animation.frames = frames;
+	animation.frame_time = frame_time;
+	animation.current = 0;
+	map.animations.push_back(animation);
+
+	//tiles placed before the animation was added have to be tracked too
+	for (u32 i = 0; i < map.layers.size(); ++i) {
+		TilemapLayer& layer = map.layers[i];
+		for (u32 cell = 0; cell < layer.tiles.size(); ++cell) {
+			if (layer.tiles[cell] != tile)
+				continue;
+			u32 x = cell % map.width;
+			u32 y = cell / map.width;
+			layer.chunks[(y / TILEMAP_CHUNK_SIZE) * map.chunks_x + (x / TILEMAP_CHUNK_SIZE)].animated.push_back(cell);
+		}
+	}
+}
+
+void update_tilemap(Tilemap& map, f32 delta) {
+	map.time += delta;
+
+	bool changed = false;
+	for (u32 i = 0; i < map.animations.size(); ++i) {
+		TileAnimation& animation = map.animations[i];
+		u16 frame = (u16)((u64)(map.time / animation.frame_time) % animation.frames);
+		if (frame != animation.current) {
+			animation.current = frame;
+			map.frames[animation.tile] = animation.tile + frame;
+			changed = true;
+		}
+	}
+	if (!changed)
+		return;
+
+	//rewriting every animated tile is cheaper than finding out which ones actually changed
+	for (u32 i = 0; i < map.layers.size(); ++i) {
+		TilemapLayer& layer = map.layers[i];
+		for (u32 j = 0; j < layer.chunks.size(); ++j) {
+			TilemapChunk& chunk = layer.chunks[j];
+			if (!chunk.built)
+				continue;
+			for (u32 k = 0; k < chunk.animated.size(); ++k) {
+				u32 cell = chunk.animated[k];
+				write_tile(map, chunk, cell % map.width, cell / map.width, layer.tiles[cell]);
+			}
+		}
+	}
+}
+
+void draw_tilemap_layer(Tilemap& map, u32 layer, Rect camera) {
+	if (layer >= map.layers.size())
+		return;
+	TilemapLayer& tiles = map.layers[layer];
+	if (tiles.chunks.empty())
+		return;
+
+	f32 chunkwidth = (f32)TILEMAP_CHUNK_SIZE * map.tile_width;
+	f32 chunkheight = (f32)TILEMAP_CHUNK_SIZE * map.tile_height;
+	i32 startx = (i32)floor(camera.x / chunkwidth);
+	i32 starty = (i32)floor(camera.y / chunkheight);
+	i32 endx = (i32)floor((camera.x + camera.width) / chunkwidth);
+	i32 endy = (i32)floor((camera.y + camera.height) / chunkheight);
+	clamp(startx, 0, (i32)map.chunks_x - 1);
+	clamp(starty, 0, (i32)map.chunks_y - 1);
+	clamp(endx, 0, (i32)map.chunks_x - 1);
+	clamp(endy, 0, (i32)map.chunks_y - 1);
+
+	for (i32 cy = starty; cy <= endy; ++cy) {
+		for (i32 cx = startx; cx <= endx; ++cx) {
+			TilemapChunk& chunk = tiles.chunks[cy * map.chunks_x + cx];
+			if (chunk.tilecount == 0)
+				continue;
+			if (!colliding(camera, rect(cx * chunkwidth, cy * chunkheight, chunkwidth, chunkheight)))
+				continue;
+			if (!chunk.built)
+				build_chunk(map, tiles, cx, cy);
+			draw_sprite_layer(chunk.sprites);
+		}
+	}
+}
+
+void draw_tilemap(Tilemap& map, Rect camera) {
+	for (u32 i = 0; i < map.layers.size(); ++i)
+		draw_tilemap_layer(map, i, camera);
+}
+
+void dispose_tilemap(Tilemap& map) {
+	for (u32 i = 0; i < map.layers.size(); ++i) {
+		TilemapLayer& layer = map.layers[i];
+		for (u32 j = 0; j < layer.chunks.size(); ++j) {
+			if (layer.chunks[j].built)
+				dispose_sprite_layer(layer.chunks[j].sprites);
+		}
+	}
+	map.layers.clear();
+	map.animations.clear();
+}
+
+#if defined(BMT_USE_NAMESPACE) 
+}
+#endif
@@ -0,0 +1,141 @@
+///////////////////////////////////////////////////////////////////////////
+// FILE:                       tilemap.h                                 //
+///////////////////////////////////////////////////////////////////////////
+//                      BAHAMUT GRAPHICS LIBRARY                         //
+//                        Author: Corbin Stark                           //
+///////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2018 Corbin Stark                                       //
+//                                                                       //
+// Permission is hereby granted, free of charge, to any person obtaining //
+// a copy of this software and associated documentation files (the       //
+// "Software"), to deal in the Software without restriction, including   //
+// without limitation the rights to use, copy, modify, merge, publish,   //
+// distribute, sublicense, and/or sell copies of the Software, and to    //
+// permit persons to whom the Software is furnished to do so, subject to //
+// the following conditions:                                             //
+//                                                                       //
+// The above copyright notice and this permission notice shall be        //
+// included in all copies or substantial portions of the Software.       //
+//                                                                       //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       //
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.//
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  //
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     //
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                //
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include "defines.h"
+#include "render2D.h"
+
+#if defined(BMT_USE_NAMESPACE) 
+namespace bmt {
+#endif
+
+//width and height of a chunk in tiles. Every chunk keeps its quads in its own SpriteLayer.
+#ifndef TILEMAP_CHUNK_SIZE
+#define TILEMAP_CHUNK_SIZE		32
+#endif
+
+#define EMPTY_TILE				0
+
+//================================================
+//Description: A tile that cycles through frames 
+//	(the tile and the frames-1 tiles after it in 
+//	the tileset) every frame_time seconds.
+//================================================
+struct TileAnimation {
+	u16 tile;
+	u16 frames;
+	f32 frame_time;
+	u16 current;
+};
+
+struct TilemapChunk {
+	SpriteLayer sprites;
+	bool built;
+	u32 tilecount;
+	std::vector<u32> handles;	//sprite handle of every cell, in row order
+	std::vector<u32> animated;	//cells holding an animated tile
+};
+
+struct TilemapLayer {
+	std::vector<u16> tiles;
+	std::vector<TilemapChunk> chunks;
+};
+
+struct Tilemap {
+	Texture tileset;
+	u32 tile_width;
+	u32 tile_height;
+	u32 columns;	//tiles per row of the tileset
+	u32 width;		//in tiles
+	u32 height;		//in tiles
+	u32 chunks_x;
+	u32 chunks_y;
+	f32 time;
+	std::vector<TilemapLayer> layers;
+	std::vector<TileAnimation> animations;
+	std::vector<u16> frames;	//the tile currently shown for every tile, changed by animations
+};
+
+//==========================================================================================
+//Description: Creates an empty tilemap
+//
+//Parameters: 
+//		-A tileset texture, read left to right and top to bottom. Tile 1 is the top left 
+//			tile, tile 0 (EMPTY_TILE) is nothing.
+//		-The width and height of one tile in pixels
+//		-The width and height of the map in tiles
+//		-(OPTIONAL) The number of layers, drawn in order (default = 1)
+//
+//Comments: The map is placed with its top left corner at (0, 0). Scroll it by uploading
+//		a view matrix to the 2D shader.
+//==========================================================================================
+Tilemap create_tilemap(Texture tileset, u32 tile_width, u32 tile_height, u32 width, u32 height, u32 layers = 1);
+//==========================================================================================
+//Description: Sets a tile of the map
+//
+//Comments: Only the one tile is rewritten, the rest of its chunk stays on the GPU as is.
+//==========================================================================================
+void set_tile(Tilemap& map, u32 layer, u32 x, u32 y, u16 tile);
+u16 get_tile(Tilemap& map, u32 layer, u32 x, u32 y);
+//==========================================================================================
+//Description: Animates every instance of a tile
+//
+//Parameters: 
+//		-A tilemap
+//		-The first tile of the animation. The frames are this tile and the ones after it.
+//		-The number of frames
+//		-The number of seconds each frame is shown
+//
+//Comments: Does nothing if there are no frames or the frame time is not above 0.
+//==========================================================================================
+void add_tile_animation(Tilemap& map, u16 tile, u16 frames, f32 frame_time);
+//==========================================================================================
+//Description: Advances tile animations. Only tiles whose frame changed are rewritten.
+//==========================================================================================
+void update_tilemap(Tilemap& map, f32 delta);
+//==========================================================================================
+//Description: Draws the chunks of the map that overlap the camera rectangle
+//
+//Parameters: 
+//		-A tilemap
+//		-The area of the map (in pixels) that is on screen
+//
+//Comments: Must be called between begin2D and end2D, see draw_sprite_layer. Chunks are 
+//		built the first time they are drawn.
+//==========================================================================================
+void draw_tilemap(Tilemap& map, Rect camera);
+void draw_tilemap_layer(Tilemap& map, u32 layer, Rect camera);
+void dispose_tilemap(Tilemap& map);
+
+#if defined(BMT_USE_NAMESPACE) 
+}
+#endif
+
+#endif
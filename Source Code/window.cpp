@@ -59,6 +59,7 @@ INTERNAL int buttons[MAX_BUTTONS];
 INTERNAL double currentTime, previousTime;
 INTERNAL double updateTime, drawTime;
 INTERNAL double frameTime = 0.0;
+INTERNAL double busyTime = 0.0;
 INTERNAL double targetTime = 0.0;
 
 INTERNAL void(*BMTKeyCallback)(int key, int action);
@@ -281,6 +282,7 @@ void end_drawing() {
 	lastScrollX = 0;
 	lastScrollY = 0;
 
+	end_frame_2D();
 	glfwSwapBuffers(glfw_window);
 	glfwPollEvents();
 
@@ -289,6 +291,7 @@ void end_drawing() {
 	previousTime = currentTime;
 
 	frameTime = updateTime + drawTime;
+	busyTime = frameTime;
 
 	// Wait for some milliseconds...
 	if (frameTime < targetTime)
@@ -328,6 +331,10 @@ double get_elapsed_time() {
 	return glfwGetTime();
 }
 
+double get_frame_time() {
+	return busyTime;
+}
+
 void set_FPS_cap(double FPS) {
 	if (FPS < 1) targetTime = 0.0;
 	else targetTime = 1.0 / FPS;